@@ -0,0 +1,116 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "Film.h"
+#include "HDRImage.h"
+#include "ImageMetrics.h"
+#include "Renderer.h"
+#include "SceneBuilder.h"
+
+struct BenchmarkOption {
+    int width = 192;
+    int height = 108;
+    int max_depth = 50;
+    int packet_size = 8;
+    bool path_guiding = false;
+    int caustic_photons = 0;  // Photons per pass, 0 disables photon mapping
+    // Cumulative render time in seconds at which errors are measured.
+    vector<double> budgets{0.5, 1, 2, 4, 8};
+    int reference_spp = 4096;
+    std::string reference_dir = "image/reference";
+};
+
+struct BenchmarkResult {
+    std::string scene;
+    double time;
+    int samples_per_pixel;
+    double mrays_per_second;
+    double rmse;
+    double rel_mse;
+    double flip;
+};
+
+// Equal-time comparison against stored high spp reference renders. The scene
+// is rendered one sample per pixel at a time; whenever the render time
+// crosses a budget the current estimate is scored against the reference.
+class Benchmark {
+   public:
+    static std::string reference_path(const std::string& scene,
+                                      const BenchmarkOption& option) {
+        return option.reference_dir + "/" + scene + "_" +
+               std::to_string(option.width) + "x" +
+               std::to_string(option.height) + ".pfm";
+    }
+
+    static void make_reference(const std::string& scene,
+                               const BenchmarkOption& option) {
+        Film film(option.width, option.height);
+        CPU_MT_Renderer renderer(SceneBuilder::by_name(scene));
+        renderer.accumulate({option.reference_spp, option.max_depth}, film);
+        std::filesystem::create_directories(option.reference_dir);
+        film.average().write_pfm(reference_path(scene, option));
+    }
+
+    static vector<BenchmarkResult> run(const std::string& scene,
+                                       const BenchmarkOption& option) {
+        HDR_Image reference =
+            HDR_Image::read_pfm(reference_path(scene, option));
+        if (reference.width != option.width ||
+            reference.height != option.height)
+            throw std::runtime_error("Reference size does not match");
+
+        Film film(option.width, option.height);
+        CPU_MT_Renderer renderer(SceneBuilder::by_name(scene));
+        RenderOption pass{1, option.max_depth, false};
+        pass.packet_size = option.packet_size;
+        pass.path_guiding = option.path_guiding;
+        pass.caustic_photons = option.caustic_photons;
+
+        vector<BenchmarkResult> results;
+        double elapsed = 0;
+        uint64_t rays = 0;
+        for (double budget : option.budgets) {
+            while (elapsed < budget) {
+                uint64_t rays_before = RayStats::total_rays;
+                auto start = std::chrono::steady_clock::now();
+                renderer.accumulate(pass, film);
+                elapsed += std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+                rays += RayStats::total_rays - rays_before;
+            }
+            HDR_Image estimate = film.average();
+            results.push_back({scene, elapsed, film.samples,
+                               rays / elapsed / 1e6,
+                               ImageMetrics::rmse(estimate, reference),
+                               ImageMetrics::rel_mse(estimate, reference),
+                               ImageMetrics::flip(estimate, reference)});
+        }
+        return results;
+    }
+
+    static void print_table(const vector<BenchmarkResult>& results,
+                            std::ostream& os = std::cout) {
+        os << "Scalar type: "
+           << (sizeof(Real) == sizeof(float) ? "float" : "double") << '\n';
+        os << std::left << std::setw(16) << "scene" << std::right
+           << std::setw(9) << "time(s)" << std::setw(7) << "spp"
+           << std::setw(10) << "Mrays/s" << std::setw(11) << "RMSE"
+           << std::setw(11) << "relMSE" << std::setw(9) << "FLIP" << '\n';
+        for (const auto& r : results) {
+            os << std::left << std::setw(16) << r.scene << std::right
+               << std::fixed << std::setprecision(2) << std::setw(9) << r.time
+               << std::setw(7) << r.samples_per_pixel << std::setw(10)
+               << r.mrays_per_second << std::setprecision(5) << std::setw(11)
+               << r.rmse << std::setw(11) << r.rel_mse << std::setprecision(4)
+               << std::setw(9) << r.flip << '\n';
+        }
+        os.unsetf(std::ios::floatfield);
+    }
+};
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "HDRImage.h"
+
+// Error metrics between a test render and a reference render of the same
+// size. All inputs are linear radiance.
+namespace ImageMetrics {
+
+inline void check_size(const HDR_Image& test, const HDR_Image& reference) {
+    if (test.width != reference.width || test.height != reference.height)
+        throw std::runtime_error("Image sizes differ");
+}
+
+// Root mean squared error over all channels.
+inline double rmse(const HDR_Image& test, const HDR_Image& reference) {
+    check_size(test, reference);
+    double sum = 0;
+    for (size_t i = 0; i < test.data.size(); ++i) {
+        sum += (test.data[i] - reference.data[i]).length_squared();
+    }
+    return sqrt(sum / (3.0 * test.data.size()));
+}
+
+// Mean squared error relative to the reference value, so dark and bright
+// regions weigh alike. eps keeps black reference pixels finite.
+inline double rel_mse(const HDR_Image& test, const HDR_Image& reference,
+                      double eps = 1e-2) {
+    check_size(test, reference);
+    double sum = 0;
+    for (size_t i = 0; i < test.data.size(); ++i) {
+        for (size_t c = 0; c < 3; ++c) {
+            double r = reference.data[i][c];
+            double d = test.data[i][c] - r;
+            sum += d * d / (r * r + eps);
+        }
+    }
+    return sum / (3.0 * test.data.size());
+}
+
+namespace detail {
+
+// Linear sRGB <-> CIE XYZ (D65).
+inline Color rgb_to_xyz(const Color& c) {
+    return {0.4124564 * c[0] + 0.3575761 * c[1] + 0.1804375 * c[2],
+            0.2126729 * c[0] + 0.7151522 * c[1] + 0.0721750 * c[2],
+            0.0193339 * c[0] + 0.1191920 * c[1] + 0.9503041 * c[2]};
+}
+
+inline Color xyz_to_rgb(const Color& c) {
+    return {3.2404542 * c[0] - 1.5371385 * c[1] - 0.4985314 * c[2],
+            -0.9692660 * c[0] + 1.8760108 * c[1] + 0.0415560 * c[2],
+            0.0556434 * c[0] - 0.2040259 * c[1] + 1.0572252 * c[2]};
+}
+
+const Color D65{0.950428545, 1.0, 1.088900371};
+
+inline double lab_f(double t) {
+    const double delta = 6.0 / 29.0;
+    return t > delta * delta * delta ? cbrt(t)
+                                     : t / (3 * delta * delta) + 4.0 / 29.0;
+}
+
+inline Color xyz_to_lab(const Color& c) {
+    double fx = lab_f(c[0] / D65[0]);
+    double fy = lab_f(c[1] / D65[1]);
+    double fz = lab_f(c[2] / D65[2]);
+    return {116 * fy - 16, 500 * (fx - fy), 200 * (fy - fz)};
+}
+
+// Opponent color space the contrast sensitivity filters work in.
+inline Color xyz_to_ycxcz(const Color& c) {
+    double y = c[1] / D65[1];
+    return {116 * y - 16, 500 * (c[0] / D65[0] - y), 200 * (y - c[2] / D65[2])};
+}
+
+inline Color ycxcz_to_xyz(const Color& c) {
+    double y = (c[0] + 16) / 116;
+    return {(y + c[1] / 500) * D65[0], y * D65[1], (y - c[2] / 200) * D65[2]};
+}
+
+// Lab with chroma scaled by lightness (Hunt effect).
+inline Color hunt_lab(const Color& rgb) {
+    Color lab = xyz_to_lab(rgb_to_xyz(rgb));
+    return {lab[0], 0.01 * lab[0] * lab[1], 0.01 * lab[0] * lab[2]};
+}
+
+inline double hyab(const Color& a, const Color& b) {
+    Color d = a - b;
+    return fabs(d[0]) + sqrt(d[1] * d[1] + d[2] * d[2]);
+}
+
+// Tone the linear radiance the way the renderer's 8 bit output does.
+inline HDR_Image display(const HDR_Image& image) {
+    HDR_Image result = image;
+    for (auto& c : result.data) {
+        c.apply([](Real& v) {
+            v = Math::clamp(sqrt(std::max<Real>(v, 0)), 0, 1);
+        });
+    }
+    return result;
+}
+
+// Convolve each YCxCz channel with its contrast sensitivity kernel, a sum of
+// two Gaussians as published with FLIP, and return the result as RGB.
+inline HDR_Image csf_filter(const HDR_Image& image, double ppd) {
+    const double a[3][2] = {{1, 0}, {1, 0}, {34.1, 13.5}};
+    const double b[3][2] = {{0.0047, 1e-5}, {0.0053, 1e-5}, {0.04, 0.025}};
+    int radius = static_cast<int>(
+        std::ceil(3 * sqrt(0.04 / (2 * Math::PI * Math::PI)) * ppd));
+
+    int size = 2 * radius + 1;
+    vector<Color> kernel(size * size);
+    Color kernel_sum{0, 0, 0};
+    for (int ky = -radius; ky <= radius; ++ky) {
+        for (int kx = -radius; kx <= radius; ++kx) {
+            double d2 = (kx * kx + ky * ky) / (ppd * ppd);
+            Color& k = kernel[(ky + radius) * size + kx + radius];
+            for (int c = 0; c < 3; ++c) {
+                for (int g = 0; g < 2; ++g) {
+                    k[c] += a[c][g] * sqrt(Math::PI / b[c][g]) *
+                            exp(-Math::PI * Math::PI * d2 / b[c][g]);
+                }
+            }
+            kernel_sum += k;
+        }
+    }
+
+    HDR_Image opponent(image.width, image.height);
+    for (size_t i = 0; i < image.data.size(); ++i) {
+        opponent.data[i] = xyz_to_ycxcz(rgb_to_xyz(image.data[i]));
+    }
+
+    HDR_Image result(image.width, image.height);
+    for (int y = 0; y < image.height; ++y) {
+        for (int x = 0; x < image.width; ++x) {
+            Color sum{0, 0, 0};
+            for (int ky = -radius; ky <= radius; ++ky) {
+                int sy = std::clamp(y + ky, 0, image.height - 1);
+                for (int kx = -radius; kx <= radius; ++kx) {
+                    int sx = std::clamp(x + kx, 0, image.width - 1);
+                    sum += kernel[(ky + radius) * size + kx + radius] *
+                           opponent.at(sx, sy);
+                }
+            }
+            sum[0] /= kernel_sum[0];
+            sum[1] /= kernel_sum[1];
+            sum[2] /= kernel_sum[2];
+            Color rgb = xyz_to_rgb(ycxcz_to_xyz(sum));
+            rgb.apply([](Real& v) { v = Math::clamp(v, 0, 1); });
+            result.at(x, y) = rgb;
+        }
+    }
+    return result;
+}
+
+// Edge and point strength from first and second derivative of Gaussian
+// filters applied to normalized luminance.
+inline vector<std::array<double, 2>> features(const HDR_Image& image,
+                                              double ppd) {
+    double sigma = 0.5 * 0.082 * ppd;
+    int radius = static_cast<int>(std::ceil(3 * sigma));
+    int size = 2 * radius + 1;
+    vector<double> g(size), dg(size), ddg(size);
+    double g_sum = 0, dg_sum = 0, ddg_sum = 0;
+    for (int i = -radius; i <= radius; ++i) {
+        double e = exp(-(i * i) / (2 * sigma * sigma));
+        g[i + radius] = e;
+        dg[i + radius] = -i * e;
+        ddg[i + radius] = (i * i / (sigma * sigma) - 1) * e;
+        g_sum += e;
+        dg_sum += fabs(dg[i + radius]);
+        ddg_sum += fabs(ddg[i + radius]);
+    }
+    for (int i = 0; i < size; ++i) {
+        g[i] /= g_sum;
+        dg[i] /= 0.5 * dg_sum;
+        ddg[i] /= 0.5 * ddg_sum;
+    }
+
+    int w = image.width, h = image.height;
+    vector<double> lum(w * h);
+    for (size_t i = 0; i < image.data.size(); ++i) {
+        lum[i] = (xyz_to_lab(rgb_to_xyz(image.data[i]))[0] + 16) / 116;
+    }
+
+    // Separable passes: derivative along one axis, smoothing along the other.
+    auto convolve = [&](const vector<double>& kx, const vector<double>& ky) {
+        vector<double> tmp(w * h), out(w * h);
+        for (int y = 0; y < h; ++y)
+            for (int x = 0; x < w; ++x) {
+                double s = 0;
+                for (int i = -radius; i <= radius; ++i)
+                    s += kx[i + radius] *
+                         lum[y * w + std::clamp(x + i, 0, w - 1)];
+                tmp[y * w + x] = s;
+            }
+        for (int y = 0; y < h; ++y)
+            for (int x = 0; x < w; ++x) {
+                double s = 0;
+                for (int i = -radius; i <= radius; ++i)
+                    s += ky[i + radius] *
+                         tmp[std::clamp(y + i, 0, h - 1) * w + x];
+                out[y * w + x] = s;
+            }
+        return out;
+    };
+    vector<double> ex = convolve(dg, g), ey = convolve(g, dg);
+    vector<double> px = convolve(ddg, g), py = convolve(g, ddg);
+
+    vector<std::array<double, 2>> result(w * h);
+    for (int i = 0; i < w * h; ++i) {
+        result[i] = {sqrt(ex[i] * ex[i] + ey[i] * ey[i]),
+                     sqrt(px[i] * px[i] + py[i] * py[i])};
+    }
+    return result;
+}
+
+}  // namespace detail
+
+// Simplified LDR FLIP: perceptual color difference after contrast
+// sensitivity filtering, amplified where edges or points differ. Both images
+// are tone mapped like the 8 bit output first. ppd is the viewing distance in
+// pixels per degree. Returns the mean error in [0, 1].
+inline double flip(const HDR_Image& test, const HDR_Image& reference,
+                   double ppd = 67.0) {
+    using namespace detail;
+    check_size(test, reference);
+    const double qc = 0.7, pc = 0.4, pt = 0.95, qf = 0.5;
+
+    HDR_Image test_ldr = display(test), reference_ldr = display(reference);
+    HDR_Image test_filtered = csf_filter(test_ldr, ppd);
+    HDR_Image reference_filtered = csf_filter(reference_ldr, ppd);
+    auto test_features = features(test_ldr, ppd);
+    auto reference_features = features(reference_ldr, ppd);
+
+    double cmax = pow(hyab(hunt_lab({0, 1, 0}), hunt_lab({0, 0, 1})), qc);
+    double sum = 0;
+    for (size_t i = 0; i < test.data.size(); ++i) {
+        double dc = pow(hyab(hunt_lab(test_filtered.data[i]),
+                             hunt_lab(reference_filtered.data[i])),
+                        qc);
+        dc = dc < pc * cmax
+                 ? pt / (pc * cmax) * dc
+                 : pt + (dc - pc * cmax) / (cmax - pc * cmax) * (1 - pt);
+
+        double df = std::max(
+            fabs(test_features[i][0] - reference_features[i][0]),
+            fabs(test_features[i][1] - reference_features[i][1]));
+        df = pow(std::min(df / sqrt(2.0), 1.0), qf);
+
+        sum += pow(std::min(dc, 1.0), 1 - df);
+    }
+    return sum / test.data.size();
+}
+
+}  // namespace ImageMetrics
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+
+#include "MathUtils.h"
+#include "Ray.h"
+#include "Vector.h"
+
+// Axis aligned bounding box.
+class AABB {
+   public:
+    Point3 min = Point3(Math::INF);
+    Point3 max = Point3(-Math::INF);
+
+   public:
+    AABB() {}
+    AABB(const Point3& min, const Point3& max) : min(min), max(max) {}
+
+    bool empty() const { return min[0] > max[0]; }
+
+    void expand(const Point3& p) {
+        for (size_t a = 0; a < 3; ++a) {
+            min[a] = std::min(min[a], p[a]);
+            max[a] = std::max(max[a], p[a]);
+        }
+    }
+
+    void expand(const AABB& box) {
+        for (size_t a = 0; a < 3; ++a) {
+            min[a] = std::min(min[a], box.min[a]);
+            max[a] = std::max(max[a], box.max[a]);
+        }
+    }
+
+    // Box linearly interpolated between start at time 0 and end at time 1.
+    static AABB lerp(const AABB& start, const AABB& end, Real time) {
+        AABB box;
+        for (size_t a = 0; a < 3; ++a) {
+            box.min[a] = start.min[a] + time * (end.min[a] - start.min[a]);
+            box.max[a] = start.max[a] + time * (end.max[a] - start.max[a]);
+        }
+        return box;
+    }
+
+    Point3 center() const { return (min + max) * 0.5; }
+
+    int longest_axis() const {
+        Vec3 extent = max - min;
+        if (extent[0] > extent[1] && extent[0] > extent[2]) return 0;
+        return extent[1] > extent[2] ? 1 : 2;
+    }
+
+    Real surface_area() const {
+        if (empty()) return 0;
+        Vec3 e = max - min;
+        return 2 * (e[0] * e[1] + e[1] * e[2] + e[2] * e[0]);
+    }
+
+    // Slab test with a precomputed reciprocal direction. Without branches
+    // per axis, which incoherent rays would mispredict half of the time.
+    // A NaN slab, from an origin on a plane of the box with the direction
+    // parallel to it, leaves the interval unchanged.
+    bool hit(const Point3& origin, const Vec3& inv_direction, Real t_min,
+             Real t_max) const {
+        for (size_t a = 0; a < 3; ++a) {
+            Real t0 = (min[a] - origin[a]) * inv_direction[a];
+            Real t1 = (max[a] - origin[a]) * inv_direction[a];
+            t_min = std::max(t_min, std::min(t0, t1));
+            t_max = std::min(t_max, std::max(t0, t1));
+        }
+        return t_min <= t_max;
+    }
+
+    bool hit(const Ray& ray, Real t_min, Real t_max) const {
+        Vec3 d = ray.direction();
+        return hit(ray.origin(), Vec3{1 / d[0], 1 / d[1], 1 / d[2]}, t_min,
+                   t_max);
+    }
+};
@@ -0,0 +1,496 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+
+#include "AABB.h"
+#include "Common.h"
+#include "Geometry.h"
+#include "RayPacket.h"
+
+// Bounding volume hierarchy over the bounded objects of a scene, stored as a
+// flat array in depth first order. Unbounded objects such as planes are
+// tested against every ray. When objects move, each node also keeps its
+// bounds at both ends of the shutter interval and rays test the bounds
+// interpolated to their time, so the tree stays tight without a rebuild
+// per time. Hits report the index of the object among those the hierarchy
+// was built from in HitRecord::primitive.
+class BVH : public Geometry {
+   private:
+    struct Node {
+        AABB box;
+        int start;  // First primitive of a leaf
+        int count;  // Primitives in a leaf, 0 for interior nodes
+        int right;  // Right child of an interior node, the left one is next
+        int axis;   // Split axis of an interior node
+    };
+
+    // Node bounds at times 0 and 1, empty when nothing moves.
+    struct MotionBox {
+        AABB start;
+        AABB end;
+    };
+
+    vector<Node> _nodes;
+    vector<MotionBox> _motion_boxes;
+    vector<shared_ptr<Geometry>> _primitives;
+    vector<AABB> _primitive_boxes;
+    vector<int> _primitive_ids;
+    vector<shared_ptr<Geometry>> _unbounded;
+    vector<int> _unbounded_ids;
+    int _leaf_size;
+
+   public:
+    static constexpr int DEFAULT_LEAF_SIZE = 4;
+
+    BVH(const vector<shared_ptr<Geometry>>& objects,
+        int leaf_size = DEFAULT_LEAF_SIZE)
+        : Geometry(nullptr), _leaf_size(std::max(leaf_size, 1)) {
+        vector<MotionBox> motion;
+        bool moving = false;
+        for (size_t id = 0; id < objects.size(); ++id) {
+            const auto& object = objects[id];
+            AABB box;
+            if (object->bounding_box(box)) {
+                MotionBox m;
+                object->motion_bounds(m.start, m.end);
+                moving = moving || !same(m.start, m.end);
+                _primitives.push_back(object);
+                _primitive_boxes.push_back(box);
+                _primitive_ids.push_back(static_cast<int>(id));
+                motion.push_back(m);
+            } else {
+                _unbounded.push_back(object);
+                _unbounded_ids.push_back(static_cast<int>(id));
+            }
+        }
+        if (_primitives.empty()) return;
+
+        vector<int> order(_primitives.size());
+        std::iota(order.begin(), order.end(), 0);
+        _nodes.reserve(2 * _primitives.size());
+        build(order, 0, static_cast<int>(order.size()));
+
+        vector<shared_ptr<Geometry>> primitives;
+        vector<AABB> boxes;
+        vector<int> ids;
+        for (int i : order) {
+            primitives.push_back(_primitives[i]);
+            boxes.push_back(_primitive_boxes[i]);
+            ids.push_back(_primitive_ids[i]);
+        }
+        _primitives.swap(primitives);
+        _primitive_boxes.swap(boxes);
+        _primitive_ids.swap(ids);
+
+        if (moving) {
+            // Children follow their parent, so a backwards pass sees them
+            // first.
+            _motion_boxes.resize(_nodes.size());
+            for (int index = static_cast<int>(_nodes.size()) - 1; index >= 0;
+                 --index) {
+                const Node& node = _nodes[index];
+                MotionBox& m = _motion_boxes[index];
+                if (node.count > 0) {
+                    for (int i = node.start; i < node.start + node.count;
+                         ++i) {
+                        m.start.expand(motion[order[i]].start);
+                        m.end.expand(motion[order[i]].end);
+                    }
+                } else {
+                    for (int child : {index + 1, node.right}) {
+                        m.start.expand(_motion_boxes[child].start);
+                        m.end.expand(_motion_boxes[child].end);
+                    }
+                }
+            }
+        }
+    }
+
+    bool hit(const Ray& ray, Real t_min, Real t_max,
+             HitRecord& rec) const override {
+        bool hit_anything = false;
+        for (size_t i = 0; i < _unbounded.size(); ++i) {
+            if (_unbounded[i]->hit(ray, t_min, t_max, rec)) {
+                hit_anything = true;
+                t_max = rec.t;
+                rec.primitive = _unbounded_ids[i];
+            }
+        }
+        if (_nodes.empty()) return hit_anything;
+
+        Point3 origin = ray.origin();
+        Vec3 d = ray.direction();
+        Vec3 inv_direction{1 / d[0], 1 / d[1], 1 / d[2]};
+        Real time = ray.time();
+
+        int stack[64];
+        int stack_size = 0;
+        stack[stack_size++] = 0;
+        while (stack_size > 0) {
+            int index = stack[--stack_size];
+            const Node& node = _nodes[index];
+            if (!hit_node(index, origin, inv_direction, time, t_min, t_max))
+                continue;
+            if (node.count > 0) {
+                for (int i = node.start; i < node.start + node.count; ++i) {
+                    if (_primitives[i]->hit(ray, t_min, t_max, rec)) {
+                        hit_anything = true;
+                        t_max = rec.t;
+                        rec.primitive = _primitive_ids[i];
+                    }
+                }
+            } else {
+                // Visit the child nearer along the ray first.
+                bool left_first = d[node.axis] >= 0;
+                stack[stack_size++] = left_first ? node.right : index + 1;
+                stack[stack_size++] = left_first ? index + 1 : node.right;
+            }
+        }
+        return hit_anything;
+    }
+
+    // Whether anything lies along the ray in (t_min, t_max). Stops at the
+    // first hit found rather than the closest, for shadow and visibility
+    // rays.
+    bool occluded(const Ray& ray, Real t_min, Real t_max) const {
+        HitRecord rec;
+        for (const auto& object : _unbounded) {
+            if (object->hit(ray, t_min, t_max, rec)) return true;
+        }
+        if (_nodes.empty()) return false;
+
+        Point3 origin = ray.origin();
+        Vec3 d = ray.direction();
+        Vec3 inv_direction{1 / d[0], 1 / d[1], 1 / d[2]};
+        Real time = ray.time();
+
+        int stack[64];
+        int stack_size = 0;
+        stack[stack_size++] = 0;
+        while (stack_size > 0) {
+            int index = stack[--stack_size];
+            const Node& node = _nodes[index];
+            if (!hit_node(index, origin, inv_direction, time, t_min, t_max))
+                continue;
+            if (node.count > 0) {
+                for (int i = node.start; i < node.start + node.count; ++i) {
+                    if (_primitives[i]->hit(ray, t_min, t_max, rec))
+                        return true;
+                }
+            } else {
+                bool left_first = d[node.axis] >= 0;
+                stack[stack_size++] = left_first ? node.right : index + 1;
+                stack[stack_size++] = left_first ? index + 1 : node.right;
+            }
+        }
+        return false;
+    }
+
+    // Closest hit for every ray of the packet. Nodes and primitives outside
+    // the packet frustum are skipped for all rays with a single test.
+    void hit_packet(RayPacket& packet, Real t_min) const {
+        packet.prepare();
+        size_t n = packet.size();
+        if (!packet.coherent) {
+            for (size_t i = 0; i < n; ++i) {
+                packet.hit[i] = hit(packet.rays[i], t_min, packet.t_max[i],
+                                    packet.records[i]);
+            }
+            return;
+        }
+
+        auto try_hit = [&](const Geometry& object, int id, size_t i) {
+            if (object.hit(packet.rays[i], t_min, packet.t_max[i],
+                           packet.records[i])) {
+                packet.hit[i] = 1;
+                packet.t_max[i] = packet.records[i].t;
+                packet.records[i].primitive = id;
+            }
+        };
+        for (size_t u = 0; u < _unbounded.size(); ++u) {
+            for (size_t i = 0; i < n; ++i)
+                try_hit(*_unbounded[u], _unbounded_ids[u], i);
+        }
+        if (_nodes.empty()) return;
+
+        Vec3 d = packet.rays[0].direction();
+        int stack[64];
+        int stack_size = 0;
+        stack[stack_size++] = 0;
+        while (stack_size > 0) {
+            int index = stack[--stack_size];
+            const Node& node = _nodes[index];
+            if (packet.frustum.outside(node.box)) continue;
+
+            bool any = false;
+            for (size_t i = 0; i < n && !any; ++i) {
+                any = hit_node(index, packet.rays[i].origin(),
+                               packet.inv_directions[i],
+                               packet.rays[i].time(), t_min, packet.t_max[i]);
+            }
+            if (!any) continue;
+
+            if (node.count > 0) {
+                for (int p = node.start; p < node.start + node.count; ++p) {
+                    if (packet.frustum.outside(_primitive_boxes[p])) continue;
+                    for (size_t i = 0; i < n; ++i)
+                        try_hit(*_primitives[p], _primitive_ids[p], i);
+                }
+            } else {
+                bool left_first = d[node.axis] >= 0;
+                stack[stack_size++] = left_first ? node.right : index + 1;
+                stack[stack_size++] = left_first ? index + 1 : node.right;
+            }
+        }
+    }
+
+    // Rays traced together by hit_lanes and occluded_lanes, stored
+    // component by component so one loop tests a node against all of them,
+    // which the compiler turns into vector instructions. Tracing them
+    // together pays off for rays that take nearly the same path, such as
+    // the neighbouring rays of a sensor sweep.
+    static constexpr int LANES = 8;
+    struct Lanes {
+        const Ray* rays[LANES];
+        Real origin[3][LANES];
+        Real inv_direction[3][LANES];
+        Real t_min[LANES];
+        Real t_max[LANES];
+        Real time[LANES];
+        int count = 0;
+
+        // Ray must outlive the trace.
+        void add(const Ray& ray, Real t_start, Real t_end) {
+            Point3 o = ray.origin();
+            Vec3 d = ray.direction();
+            for (size_t a = 0; a < 3; ++a) {
+                origin[a][count] = o[a];
+                inv_direction[a][count] = 1 / d[a];
+            }
+            t_min[count] = t_start;
+            t_max[count] = t_end;
+            time[count] = ray.time();
+            rays[count++] = &ray;
+        }
+
+        // Whether the origins lie within spread of the first and the
+        // directions within a few degrees of its direction.
+        bool coherent(Real spread) const {
+            Vec3 first = rays[0]->direction().unit_vector();
+            for (int l = 1; l < count; ++l) {
+                Real distance2 = 0;
+                for (size_t a = 0; a < 3; ++a) {
+                    Real d = origin[a][l] - origin[a][0];
+                    distance2 += d * d;
+                }
+                if (distance2 > spread * spread ||
+                    rays[l]->direction().unit_vector().dot(first) <
+                        COHERENT_COSINE)
+                    return false;
+            }
+            return true;
+        }
+    };
+
+    // hit() for every ray of lanes. hit gets 1 or 0 per ray and records
+    // the closest hit of those that hit.
+    void hit_lanes(Lanes& lanes, HitRecord* records, uint8_t* hit) const {
+        trace_lanes<false>(lanes, records, hit);
+    }
+
+    // occluded() for every ray of lanes, 1 or 0 per ray into occluded.
+    void occluded_lanes(Lanes& lanes, uint8_t* occluded) const {
+        HitRecord records[LANES];
+        trace_lanes<true>(lanes, records, occluded);
+    }
+
+    int leaf_size() const { return _leaf_size; }
+
+    // Bounds of the bounded objects only, over the whole shutter interval.
+    AABB primitive_bounds() const {
+        return _nodes.empty() ? AABB() : _nodes[0].box;
+    }
+
+    // Memory held by the hierarchy itself, not counting the objects.
+    size_t memory_bytes() const {
+        return sizeof(BVH) + _nodes.capacity() * sizeof(Node) +
+               (_primitives.capacity() + _unbounded.capacity()) *
+                   sizeof(shared_ptr<Geometry>) +
+               _primitive_boxes.capacity() * sizeof(AABB) +
+               (_primitive_ids.capacity() + _unbounded_ids.capacity()) *
+                   sizeof(int) +
+               _motion_boxes.capacity() * sizeof(MotionBox);
+    }
+
+    bool bounding_box(AABB& output_box) const override {
+        if (!_unbounded.empty() || _nodes.empty()) return false;
+        output_box = _nodes[0].box;
+        return true;
+    }
+
+   private:
+    static bool same(const AABB& a, const AABB& b) {
+        for (size_t i = 0; i < 3; ++i) {
+            if (a.min[i] != b.min[i] || a.max[i] != b.max[i]) return false;
+        }
+        return true;
+    }
+
+    // Unit directions of coherent lanes are at most about 8 degrees apart.
+    static constexpr Real COHERENT_COSINE = 0.99;
+
+    template <bool ANY_HIT>
+    void trace_lanes(Lanes& lanes, HitRecord* records, uint8_t* hit) const {
+        // Unused lanes get an empty interval and never hit.
+        for (int l = lanes.count; l < LANES; ++l) {
+            for (size_t a = 0; a < 3; ++a) {
+                lanes.origin[a][l] = 0;
+                lanes.inv_direction[a][l] = 1;
+            }
+            lanes.t_min[l] = Math::INF;
+            lanes.t_max[l] = -Math::INF;
+            lanes.time[l] = 0;
+        }
+        // Lanes still looking for a hit.
+        unsigned int active = (1u << lanes.count) - 1;
+        for (int l = 0; l < lanes.count; ++l) hit[l] = 0;
+
+        auto test = [&](const Geometry& object, int id, unsigned int mask) {
+            for (int l = 0; l < lanes.count; ++l) {
+                if (!(mask & active & (1u << l))) continue;
+                HitRecord& rec = records[l];
+                if (!object.hit(*lanes.rays[l], lanes.t_min[l],
+                                lanes.t_max[l], rec))
+                    continue;
+                hit[l] = 1;
+                rec.primitive = id;
+                if (ANY_HIT) {
+                    active &= ~(1u << l);
+                    lanes.t_max[l] = -Math::INF;
+                } else {
+                    lanes.t_max[l] = rec.t;
+                }
+            }
+        };
+        for (size_t u = 0; u < _unbounded.size(); ++u)
+            test(*_unbounded[u], _unbounded_ids[u], active);
+        if (_nodes.empty()) return;
+
+        // Children are visited in the order that suits the first ray.
+        bool positive[3];
+        for (size_t a = 0; a < 3; ++a)
+            positive[a] = lanes.inv_direction[a][0] >= 0;
+        int stack[64];
+        int stack_size = 0;
+        stack[stack_size++] = 0;
+        while (stack_size > 0 && active) {
+            int index = stack[--stack_size];
+            const Node& node = _nodes[index];
+            unsigned int mask = hit_node_lanes(index, lanes) & active;
+            if (!mask) continue;
+            if (node.count > 0) {
+                for (int i = node.start; i < node.start + node.count; ++i)
+                    test(*_primitives[i], _primitive_ids[i], mask);
+            } else {
+                bool left_first = positive[node.axis];
+                stack[stack_size++] = left_first ? node.right : index + 1;
+                stack[stack_size++] = left_first ? index + 1 : node.right;
+            }
+        }
+    }
+
+    // Bit per lane whose ray passes the bounds of node index.
+    unsigned int hit_node_lanes(int index, const Lanes& lanes) const {
+        bool inside[LANES];
+        if (_motion_boxes.empty()) {
+            const AABB& box = _nodes[index].box;
+            slab_lanes(lanes, inside, [&](size_t a, int) {
+                return std::make_pair(box.min[a], box.max[a]);
+            });
+        } else {
+            const MotionBox& m = _motion_boxes[index];
+            slab_lanes(lanes, inside, [&](size_t a, int l) {
+                Real time = lanes.time[l];
+                return std::make_pair(
+                    m.start.min[a] + time * (m.end.min[a] - m.start.min[a]),
+                    m.start.max[a] + time * (m.end.max[a] - m.start.max[a]));
+            });
+        }
+        unsigned int mask = 0;
+        for (int l = 0; l < LANES; ++l)
+            mask |= static_cast<unsigned int>(inside[l]) << l;
+        return mask;
+    }
+
+    // Slab test of every lane against the bounds that bounds(axis, lane)
+    // returns as a pair of minimum and maximum.
+    template <typename Bounds>
+    static void slab_lanes(const Lanes& lanes, bool* inside,
+                           const Bounds& bounds) {
+        for (int l = 0; l < LANES; ++l) {
+            Real t_min = lanes.t_min[l], t_max = lanes.t_max[l];
+            for (size_t a = 0; a < 3; ++a) {
+                auto [min, max] = bounds(a, l);
+                Real inv = lanes.inv_direction[a][l];
+                Real t0 = (min - lanes.origin[a][l]) * inv;
+                Real t1 = (max - lanes.origin[a][l]) * inv;
+                t_min = std::max(t_min, std::min(t0, t1));
+                t_max = std::min(t_max, std::max(t0, t1));
+            }
+            inside[l] = t_min <= t_max;
+        }
+    }
+
+    // Slab test against the bounds of node index at time.
+    bool hit_node(int index, const Point3& origin, const Vec3& inv_direction,
+                  Real time, Real t_min, Real t_max) const {
+        if (_motion_boxes.empty())
+            return _nodes[index].box.hit(origin, inv_direction, t_min, t_max);
+        const MotionBox& m = _motion_boxes[index];
+        for (size_t a = 0; a < 3; ++a) {
+            Real min = m.start.min[a] + time * (m.end.min[a] - m.start.min[a]);
+            Real max = m.start.max[a] + time * (m.end.max[a] - m.start.max[a]);
+            Real t0 = (min - origin[a]) * inv_direction[a];
+            Real t1 = (max - origin[a]) * inv_direction[a];
+            t_min = std::max(t_min, std::min(t0, t1));
+            t_max = std::min(t_max, std::max(t0, t1));
+        }
+        return t_min <= t_max;
+    }
+
+    // Median split along the longest axis of the primitive centers.
+    int build(vector<int>& order, int begin, int end) {
+        int index = static_cast<int>(_nodes.size());
+        _nodes.push_back({});
+
+        AABB box, centers;
+        for (int i = begin; i < end; ++i) {
+            box.expand(_primitive_boxes[order[i]]);
+            centers.expand(_primitive_boxes[order[i]].center());
+        }
+        _nodes[index].box = box;
+
+        int count = end - begin;
+        if (count <= _leaf_size) {
+            _nodes[index].start = begin;
+            _nodes[index].count = count;
+            return index;
+        }
+
+        int axis = centers.longest_axis();
+        int mid = begin + count / 2;
+        std::nth_element(order.begin() + begin, order.begin() + mid,
+                         order.begin() + end, [&](int a, int b) {
+                             return _primitive_boxes[a].center()[axis] <
+                                    _primitive_boxes[b].center()[axis];
+                         });
+        build(order, begin, mid);
+        int right = build(order, mid, end);
+        _nodes[index].count = 0;
+        _nodes[index].right = right;
+        _nodes[index].axis = axis;
+        return index;
+    }
+};
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#include "AABB.h"
+#include "Common.h"
+
+class Material;
+
+// Sphere as stored on disk. material indexes the table a scene supplies
+// when it opens the file.
+struct SphereRecord {
+    float center[3];
+    float radius;
+    uint32_t material;
+};
+
+struct ClusterInfo {
+    AABB bounds;
+    uint64_t offset;  // Byte offset of the cluster's records
+    uint32_t count;
+};
+
+// Spheres grouped into spatially coherent clusters, so a renderer can keep
+// only the clusters' bounds in memory and read the clusters rays reach.
+//
+// Layout: "RTGC", then uint32 version and cluster count, then per cluster
+// six float bounds, uint64 offset and uint32 count, then the records of
+// every cluster. Each cluster starts on a page boundary and records are
+// the in-memory structs as they are, so the file can also be memory
+// mapped. Numbers are in the writing host's byte order, so files are only
+// read back on hosts of the same byte order.
+class ClusterFile {
+   private:
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint64_t PAGE_SIZE = 4096;
+    static constexpr size_t HEADER_SIZE = 4 + 2 * sizeof(uint32_t);
+    static constexpr size_t ENTRY_SIZE =
+        6 * sizeof(float) + sizeof(uint64_t) + sizeof(uint32_t);
+
+    std::string _filename;
+    int _id;
+    vector<ClusterInfo> _clusters;
+    vector<shared_ptr<Material>> _materials;
+    mutable std::ifstream _file;
+    mutable std::mutex _mutex;
+
+   public:
+    // id tells files apart in a GeometryCache.
+    ClusterFile(const std::string& filename,
+                vector<shared_ptr<Material>> materials, int id = 0)
+        : _filename(filename), _id(id), _materials(std::move(materials)) {
+        _file.open(filename, std::ios::binary);
+        if (!_file) throw std::runtime_error("Cannot open " + filename);
+
+        char magic[4];
+        uint32_t header[2];
+        _file.read(magic, 4);
+        _file.read(reinterpret_cast<char*>(header), sizeof(header));
+        if (!_file || std::string(magic, 4) != "RTGC" || header[0] != VERSION)
+            throw std::runtime_error("Not a cluster file: " + filename);
+
+        _clusters.resize(header[1]);
+        for (auto& cluster : _clusters) {
+            float bounds[6];
+            _file.read(reinterpret_cast<char*>(bounds), sizeof(bounds));
+            _file.read(reinterpret_cast<char*>(&cluster.offset),
+                       sizeof(cluster.offset));
+            _file.read(reinterpret_cast<char*>(&cluster.count),
+                       sizeof(cluster.count));
+            cluster.bounds = AABB(Point3{bounds[0], bounds[1], bounds[2]},
+                                  Point3{bounds[3], bounds[4], bounds[5]});
+        }
+        if (!_file) throw std::runtime_error("Truncated " + filename);
+    }
+
+    const std::string& filename() const { return _filename; }
+    int id() const { return _id; }
+    size_t clusters() const { return _clusters.size(); }
+    const ClusterInfo& cluster(size_t i) const { return _clusters[i]; }
+
+    const shared_ptr<Material>& material(uint32_t i) const {
+        if (i >= _materials.size())
+            throw std::runtime_error("Missing material in " + _filename);
+        return _materials[i];
+    }
+
+    // Read one cluster's records. Safe to call from several threads.
+    vector<SphereRecord> read_cluster(size_t i) const {
+        const ClusterInfo& info = _clusters[i];
+        vector<SphereRecord> records(info.count);
+        std::lock_guard<std::mutex> lock(_mutex);
+        _file.seekg(info.offset);
+        _file.read(reinterpret_cast<char*>(records.data()),
+                   info.count * sizeof(SphereRecord));
+        if (!_file) throw std::runtime_error("Truncated " + _filename);
+        return records;
+    }
+
+    // Split spheres into clusters of at most cluster_size by median splits
+    // along the longest axis of their centers, and write them.
+    static void write(vector<SphereRecord> spheres,
+                      const std::string& filename, size_t cluster_size = 1024) {
+        cluster_size = std::max<size_t>(cluster_size, 1);
+        vector<std::pair<size_t, size_t>> ranges;
+        partition(spheres, 0, spheres.size(), cluster_size, ranges);
+
+        std::ofstream outfile(filename, std::ios::binary);
+        if (!outfile) throw std::runtime_error("Cannot write " + filename);
+        uint32_t header[2] = {VERSION, static_cast<uint32_t>(ranges.size())};
+        outfile.write("RTGC", 4);
+        outfile.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+        uint64_t offset = align(HEADER_SIZE + ranges.size() * ENTRY_SIZE);
+        for (const auto& [begin, end] : ranges) {
+            // Round the bounds outwards so they still enclose the spheres.
+            AABB box = bounds(spheres, begin, end);
+            float b[6];
+            for (int a = 0; a < 3; ++a) {
+                b[a] = std::nextafter(static_cast<float>(box.min[a]),
+                                      -INFINITY);
+                b[a + 3] = std::nextafter(static_cast<float>(box.max[a]),
+                                          INFINITY);
+            }
+            uint32_t count = static_cast<uint32_t>(end - begin);
+            outfile.write(reinterpret_cast<const char*>(b), sizeof(b));
+            outfile.write(reinterpret_cast<const char*>(&offset),
+                          sizeof(offset));
+            outfile.write(reinterpret_cast<const char*>(&count),
+                          sizeof(count));
+            offset = align(offset + count * sizeof(SphereRecord));
+        }
+        for (const auto& [begin, end] : ranges) {
+            outfile.seekp(align(outfile.tellp()));
+            outfile.write(reinterpret_cast<const char*>(&spheres[begin]),
+                          (end - begin) * sizeof(SphereRecord));
+        }
+        if (!outfile) throw std::runtime_error("Cannot write " + filename);
+    }
+
+   private:
+    static uint64_t align(uint64_t offset) {
+        return (offset + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+    }
+
+    static AABB bounds(const vector<SphereRecord>& spheres, size_t begin,
+                       size_t end) {
+        AABB box;
+        for (size_t i = begin; i < end; ++i) {
+            const SphereRecord& s = spheres[i];
+            Point3 c{s.center[0], s.center[1], s.center[2]};
+            Vec3 r(s.radius);
+            box.expand(AABB(c - r, c + r));
+        }
+        return box;
+    }
+
+    static void partition(vector<SphereRecord>& spheres, size_t begin,
+                          size_t end, size_t cluster_size,
+                          vector<std::pair<size_t, size_t>>& ranges) {
+        if (end - begin <= cluster_size) {
+            if (end > begin) ranges.emplace_back(begin, end);
+            return;
+        }
+        AABB centers;
+        for (size_t i = begin; i < end; ++i) {
+            const float* c = spheres[i].center;
+            centers.expand(Point3{c[0], c[1], c[2]});
+        }
+        int axis = centers.longest_axis();
+        size_t mid = begin + (end - begin) / 2;
+        std::nth_element(spheres.begin() + begin, spheres.begin() + mid,
+                         spheres.begin() + end,
+                         [axis](const SphereRecord& a, const SphereRecord& b) {
+                             return a.center[axis] < b.center[axis];
+                         });
+        partition(spheres, begin, mid, cluster_size, ranges);
+        partition(spheres, mid, end, cluster_size, ranges);
+    }
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+
+#include "AABB.h"
+#include "Common.h"
+#include "Ray.h"
+
+// Four planes bounding a bundle of rays. A point p is inside when
+// normal.dot(p) >= offset for every plane.
+class Frustum {
+   public:
+    std::array<Vec3, 4> normals;
+    std::array<Real, 4> offsets;
+
+   public:
+    // Bound rays that all travel along forward, starting on or in front of
+    // the plane through center perpendicular to forward. In that frame every
+    // ray is x = b + a * z, so the extreme slopes and intercepts give planes
+    // no ray crosses for z >= 0. Returns false if some ray does not move
+    // forward, in which case no frustum exists.
+    bool bound(const vector<Ray>& rays, const Point3& center,
+               const Vec3& right, const Vec3& up, const Vec3& forward) {
+        Real a_min[2] = {Math::INF, Math::INF};
+        Real a_max[2] = {-Math::INF, -Math::INF};
+        Real b_min[2] = {Math::INF, Math::INF};
+        Real b_max[2] = {-Math::INF, -Math::INF};
+        const Vec3* axes[2] = {&right, &up};
+
+        for (const auto& ray : rays) {
+            Vec3 d = ray.direction();
+            Vec3 o = ray.origin() - center;
+            Real dz = d.dot(forward);
+            Real oz = o.dot(forward);
+            // Origins on the plane may round to slightly behind it.
+            Real tolerance =
+                1e-8 + Math::gamma(4) * (Math::abs(ray.origin()) +
+                                         Math::abs(center))
+                                            .dot(Math::abs(forward));
+            if (dz <= 1e-8 || oz < -tolerance) return false;
+            for (int i = 0; i < 2; ++i) {
+                Real a = d.dot(*axes[i]) / dz;
+                Real b = o.dot(*axes[i]) - a * oz;
+                a_min[i] = std::min(a_min[i], a);
+                a_max[i] = std::max(a_max[i], a);
+                b_min[i] = std::min(b_min[i], b);
+                b_max[i] = std::max(b_max[i], b);
+            }
+        }
+
+        for (int i = 0; i < 2; ++i) {
+            // x - a_min * z >= b_min and a_max * z - x >= -b_max
+            normals[2 * i] = *axes[i] - a_min[i] * forward;
+            offsets[2 * i] = b_min[i] + normals[2 * i].dot(center);
+            normals[2 * i + 1] = a_max[i] * forward - *axes[i];
+            offsets[2 * i + 1] = -b_max[i] + normals[2 * i + 1].dot(center);
+        }
+        return true;
+    }
+
+    // True if box lies entirely outside one of the planes.
+    bool outside(const AABB& box) const {
+        for (int i = 0; i < 4; ++i) {
+            const Vec3& n = normals[i];
+            Real farthest = 0;
+            for (size_t a = 0; a < 3; ++a) {
+                farthest += n[a] * (n[a] > 0 ? box.max[a] : box.min[a]);
+            }
+            if (farthest < offsets[i]) return true;
+        }
+        return false;
+    }
+};
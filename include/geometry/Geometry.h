@@ -2,21 +2,68 @@
 
 #include <cmath>
 
+#include "AABB.h"
+#include "Common.h"
 #include "Ray.h"
 #include "Vector.h"
 
+class Geometry;
 class Material;
 
 struct HitRecord {
-    Point3d point;
-    Vec3d normal;
-    double t;
+    Point3 point;
+    Vec3 normal;
+    Real t;
+    // Time of the ray that found the hit, which rays leaving it keep.
+    Real time = 0;
     bool front_face;
-    shared_ptr<Material> material;
-    inline void set_face_normal(const Ray& r, const Vec3d& outward_normal) {
+    // Owned by the object that was hit, so a hit costs no reference count.
+    const Material* material = nullptr;
+    // Primitive that was hit, so emitters can be recognized.
+    const Geometry* object = nullptr;
+    // Index of that primitive among the objects the BVH was built from, -1
+    // when it was not found through a BVH. Nested hierarchies report the
+    // index in the outermost one.
+    int primitive = -1;
+    // Surface coordinates, and the world space length one unit of them
+    // spans, so textures can turn a footprint into texels.
+    Real u = 0;
+    Real v = 0;
+    Real uv_length = 1;
+    // World space width of the ray cone at the hit, set by the integrator.
+    Real footprint = 0;
+    // Per axis bound on the rounding error in point.
+    Vec3 error = Vec3(0);
+    inline void set_face_normal(const Ray& r, const Vec3& outward_normal) {
         front_face = r.direction().dot(outward_normal) < 0;
         normal = front_face ? outward_normal : -outward_normal;
     }
+
+    // Ray leaving the surface towards direction. Its origin is pushed along
+    // the normal just past the error in point, to the side direction points
+    // to, so the ray cannot hit this surface again at t near 0 however
+    // coarse Real is. Rays spawned this way are traced with t_min 0.
+    // Points in a medium have no surface to leave and no normal.
+    Ray spawn_ray(const Vec3& direction) const {
+        Real length2 = normal.length_squared();
+        if (length2 == 0) return Ray(point, direction, time);
+        Real d = fabs(normal[0]) * error[0] + fabs(normal[1]) * error[1] +
+                 fabs(normal[2]) * error[2];
+        // d / |n| along n / |n|.
+        Real scale = d / length2;
+        if (direction.dot(normal) < 0) scale = -scale;
+        Point3 origin = point;
+        for (size_t a = 0; a < 3; ++a) {
+            Real offset = scale * normal[a];
+            origin[a] += offset;
+            // Round away from the surface so the addition cannot undo it.
+            if (offset > 0)
+                origin[a] = std::nextafter(origin[a], Math::INF);
+            else if (offset < 0)
+                origin[a] = std::nextafter(origin[a], -Math::INF);
+        }
+        return Ray(origin, direction, time);
+    }
 };
 
 class Geometry {
@@ -27,6 +74,37 @@ class Geometry {
     Geometry(shared_ptr<Material> material) : _material(material) {}
     virtual ~Geometry() = default;
     // Returns normal
-    virtual bool hit(const Ray& ray, double t_min, double t_max,
+    virtual bool hit(const Ray& ray, Real t_min, Real t_max,
                      HitRecord& r_rec) const = 0;
+    // Bounds of the object over the whole shutter interval, false for
+    // unbounded objects such as planes.
+    virtual bool bounding_box(AABB& output_box) const { return false; }
+
+    // Bounds at times 0 and 1 whose linear interpolation holds the object
+    // at every time in between. Static objects return their bounding box
+    // for both.
+    virtual bool motion_bounds(AABB& start, AABB& end) const {
+        if (!bounding_box(start)) return false;
+        end = start;
+        return true;
+    }
+
+    const shared_ptr<Material>& material() const { return _material; }
+
+    // Surface area, 0 for objects that cannot be sampled.
+    virtual Real area() const { return 0; }
+
+    // Uniformly distributed point on the surface at time and its outward
+    // normal.
+    virtual Point3 sample_point(Vec3& normal, Real time) const {
+        normal = Vec3{0, 0, 1};
+        return Point3{0, 0, 0};
+    }
+
+    // Cone around axis that holds every outward normal of the surface, as
+    // the cosine of its half angle. -1 means any direction.
+    virtual Real normal_bounds(Vec3& axis) const {
+        axis = Vec3{0, 0, 1};
+        return -1;
+    }
 };
\ No newline at end of file
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "BVH.h"
+#include "ClusterFile.h"
+#include "Common.h"
+#include "Geometry.h"
+#include "ShardedCache.h"
+#include "Sphere.h"
+
+// Clusters of out-of-core geometry, read from their files on first use and
+// evicted least recently used first once the resident clusters exceed the
+// memory budget. See ShardedCache for how the budget is split and held.
+class GeometryCache {
+   public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t page_ins;
+        uint64_t evictions;
+        uint64_t bytes_read;
+        size_t resident_bytes;
+        size_t peak_bytes;
+    };
+
+    // Resident form of a cluster.
+    struct Cluster {
+        BVH bvh;
+        size_t bytes;
+    };
+    using ClusterPtr = ShardedCache<Cluster>::Ptr;
+
+   private:
+    ShardedCache<Cluster> _clusters;
+    std::atomic<int> _next_id{0};
+    std::atomic<uint64_t> _bytes_read{0};
+
+   public:
+    explicit GeometryCache(size_t budget_bytes)
+        : _clusters(budget_bytes, "geometry cluster") {}
+
+    size_t budget() const { return _clusters.budget(); }
+
+    // Open a cluster file for use with this cache. Only its cluster table
+    // is read here.
+    shared_ptr<ClusterFile> open(const std::string& filename,
+                                 vector<shared_ptr<Material>> materials) {
+        return make_shared<ClusterFile>(filename, std::move(materials),
+                                        _next_id++);
+    }
+
+    ClusterPtr fetch(const ClusterFile& file, size_t cluster) {
+        uint64_t key = (static_cast<uint64_t>(file.id()) << 40) | cluster;
+        return _clusters.fetch(key, [&] {
+            _bytes_read += file.cluster(cluster).count * sizeof(SphereRecord);
+            ClusterPtr loaded = load(file, cluster);
+            return std::make_pair(loaded, loaded->bytes);
+        });
+    }
+
+    Stats stats() const {
+        ShardedCache<Cluster>::Stats s = _clusters.stats();
+        return {s.hits,      s.misses,         s.evictions,
+                _bytes_read, s.resident_bytes, s.peak_bytes};
+    }
+
+   private:
+    static ClusterPtr load(const ClusterFile& file, size_t cluster) {
+        vector<shared_ptr<Geometry>> spheres;
+        for (const SphereRecord& r : file.read_cluster(cluster)) {
+            spheres.push_back(make_shared<Sphere>(
+                Point3{r.center[0], r.center[1], r.center[2]}, r.radius,
+                file.material(r.material)));
+        }
+        // Spheres are allocated with their shared_ptr control blocks.
+        size_t sphere_bytes = sizeof(Sphere) + 2 * sizeof(void*) + 8;
+        BVH bvh(spheres);
+        size_t bytes = bvh.memory_bytes() + spheres.size() * sphere_bytes;
+        return make_shared<const Cluster>(Cluster{std::move(bvh), bytes});
+    }
+};
+
+// One cluster of a ClusterFile standing in for its spheres. Only the bounds
+// are resident; hit() pages the spheres in through the cache when a ray
+// reaches the bounds.
+class PagedCluster : public Geometry {
+   private:
+    shared_ptr<GeometryCache> _cache;
+    shared_ptr<ClusterFile> _file;
+    size_t _index;
+
+   public:
+    PagedCluster(shared_ptr<GeometryCache> cache,
+                 shared_ptr<ClusterFile> file, size_t index)
+        : Geometry(nullptr), _cache(cache), _file(file), _index(index) {}
+
+    bool hit(const Ray& ray, Real t_min, Real t_max,
+             HitRecord& rec) const override {
+        if (!_file->cluster(_index).bounds.hit(ray, t_min, t_max)) return false;
+        return _cache->fetch(*_file, _index)->bvh.hit(ray, t_min, t_max, rec);
+    }
+
+    bool bounding_box(AABB& output_box) const override {
+        output_box = _file->cluster(_index).bounds;
+        return true;
+    }
+
+    // One PagedCluster for every cluster of file.
+    static vector<shared_ptr<Geometry>> all(shared_ptr<GeometryCache> cache,
+                                            shared_ptr<ClusterFile> file) {
+        vector<shared_ptr<Geometry>> clusters;
+        for (size_t i = 0; i < file->clusters(); ++i) {
+            clusters.push_back(make_shared<PagedCluster>(cache, file, i));
+        }
+        return clusters;
+    }
+};
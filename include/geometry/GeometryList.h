@@ -16,8 +16,11 @@ class GeometryList : public Geometry {
 
     void clear() { _geometries.clear(); }
     void add(shared_ptr<Geometry> object) { _geometries.push_back(object); }
+    const std::vector<shared_ptr<Geometry>>& objects() const {
+        return _geometries;
+    }
 
-    virtual bool hit(const Ray& r, double t_min, double t_max,
+    virtual bool hit(const Ray& r, Real t_min, Real t_max,
                      HitRecord& rec) const override {
         HitRecord temp_rec;
         bool hit_anything = false;
@@ -32,4 +35,14 @@ class GeometryList : public Geometry {
         }
         return hit_anything;
     }
+
+    bool bounding_box(AABB& output_box) const override {
+        output_box = AABB();
+        for (const auto& geometry : _geometries) {
+            AABB box;
+            if (!geometry->bounding_box(box)) return false;
+            output_box.expand(box);
+        }
+        return !_geometries.empty();
+    }
 };
\ No newline at end of file
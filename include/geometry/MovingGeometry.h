@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "Geometry.h"
+
+// Offset of a moving object at a time within the shutter interval.
+struct Keyframe {
+    Real time;
+    Vec3 offset;
+};
+
+// An object translated along a path through keyframes, linearly in
+// between them and held at the first and last one outside. Rays are
+// moved into the object's frame at their own time, so a single scene and
+// BVH render the whole shutter interval.
+class MovingGeometry : public Geometry {
+   private:
+    shared_ptr<Geometry> _object;
+    vector<Keyframe> _keyframes;
+
+   public:
+    MovingGeometry(shared_ptr<Geometry> object, vector<Keyframe> keyframes)
+        : Geometry(object->material()),
+          _object(object),
+          _keyframes(std::move(keyframes)) {
+        if (_keyframes.empty())
+            throw std::runtime_error("Moving object without keyframes");
+        for (size_t i = 1; i < _keyframes.size(); ++i) {
+            if (_keyframes[i].time < _keyframes[i - 1].time)
+                throw std::runtime_error("Keyframes out of order");
+        }
+    }
+
+    // Linear motion by velocity over the shutter interval.
+    MovingGeometry(shared_ptr<Geometry> object, const Vec3& velocity)
+        : MovingGeometry(object, {{0, Vec3(0)}, {1, velocity}}) {}
+
+    Vec3 offset(Real time) const {
+        if (time <= _keyframes.front().time) return _keyframes.front().offset;
+        if (time >= _keyframes.back().time) return _keyframes.back().offset;
+        auto next = std::upper_bound(
+            _keyframes.begin(), _keyframes.end(), time,
+            [](Real t, const Keyframe& k) { return t < k.time; });
+        auto previous = next - 1;
+        Real s = (time - previous->time) / (next->time - previous->time);
+        Vec3 result;
+        for (size_t a = 0; a < 3; ++a)
+            result[a] = previous->offset[a] +
+                        s * (next->offset[a] - previous->offset[a]);
+        return result;
+    }
+
+    bool hit(const Ray& ray, Real t_min, Real t_max,
+             HitRecord& r_rec) const override {
+        // Component loops rather than vector operators, this runs for every
+        // ray reaching the object.
+        Vec3 shift = offset(ray.time());
+        Point3 origin = ray.origin();
+        for (size_t a = 0; a < 3; ++a) origin[a] -= shift[a];
+        if (!_object->hit(Ray(origin, ray.direction(), ray.time()), t_min,
+                          t_max, r_rec))
+            return false;
+        for (size_t a = 0; a < 3; ++a) {
+            r_rec.point[a] += shift[a];
+            // Moving the point back rounds once more.
+            r_rec.error[a] += Math::gamma(1) * fabs(r_rec.point[a]);
+        }
+        r_rec.object = this;
+        return true;
+    }
+
+    bool bounding_box(AABB& output_box) const override {
+        AABB box;
+        if (!_object->bounding_box(box)) return false;
+        output_box = AABB();
+        for (const auto& k : _keyframes)
+            output_box.expand(moved(box, k.offset));
+        return true;
+    }
+
+    // Boxes at the ends of the interval, widened until their interpolation
+    // also holds the object at the keyframes in between.
+    bool motion_bounds(AABB& start, AABB& end) const override {
+        AABB box;
+        if (!_object->bounding_box(box)) return false;
+        start = moved(box, offset(0));
+        end = moved(box, offset(1));
+        Vec3 below(0), above(0);
+        for (const auto& k : _keyframes) {
+            if (k.time <= 0 || k.time >= 1) continue;
+            AABB at = moved(box, k.offset);
+            AABB bound = AABB::lerp(start, end, k.time);
+            for (size_t a = 0; a < 3; ++a) {
+                below[a] = std::max(below[a], bound.min[a] - at.min[a]);
+                above[a] = std::max(above[a], at.max[a] - bound.max[a]);
+            }
+        }
+        start = AABB(start.min - below, start.max + above);
+        end = AABB(end.min - below, end.max + above);
+        return true;
+    }
+
+    Real area() const override { return _object->area(); }
+
+    Point3 sample_point(Vec3& normal, Real time) const override {
+        return _object->sample_point(normal, time) + offset(time);
+    }
+
+    Real normal_bounds(Vec3& axis) const override {
+        return _object->normal_bounds(axis);
+    }
+
+   private:
+    static AABB moved(const AABB& box, const Vec3& offset) {
+        return AABB(box.min + offset, box.max + offset);
+    }
+};
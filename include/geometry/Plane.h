@@ -4,34 +4,71 @@
 
 #include "Geometry.h"
 
+// Point p moved onto the plane through origin with the given normal. The
+// ray parameter of a hit carries the rounding of the whole intersection,
+// projecting removes most of it.
+inline Point3 project(const Point3& p, const Point3& origin,
+                      const Vec3& normal) {
+    Real distance = 0;
+    for (size_t a = 0; a < 3; ++a) distance += (p[a] - origin[a]) * normal[a];
+    Real scale = distance / normal.length_squared();
+    Point3 result = p;
+    for (size_t a = 0; a < 3; ++a) result[a] -= scale * normal[a];
+    return result;
+}
+
+// Error bound of a point projected onto a plane through origin.
+inline Vec3 plane_error(const Point3& p, const Point3& origin) {
+    Vec3 error;
+    for (size_t a = 0; a < 3; ++a)
+        error[a] = Math::gamma(7) * (fabs(p[a]) + fabs(origin[a]));
+    return error;
+}
+
 class Plane : public Geometry {
    private:
-    Point3d _center;
-    Vec3d _normal;
+    Point3 _center;
+    Vec3 _normal;  // Unit length
+    // Tangent frame for world space texture coordinates.
+    Vec3 _tangent;
+    Vec3 _bitangent;
 
    public:
-    Plane(Point3d center, Vec3d normal, shared_ptr<Material> material)
-        : Geometry(material), _center(center), _normal(normal) {}
-    bool hit(const Ray& ray, double t_min, double t_max,
+    Plane(Point3 center, Vec3 normal, shared_ptr<Material> material)
+        : Geometry(material),
+          _center(center),
+          _normal(normal.unit_vector()) {
+        Vec3 a = fabs(_normal.x()) > 0.9 ? Vec3{0, 1, 0} : Vec3{1, 0, 0};
+        _tangent = _normal.cross(a).unit_vector();
+        _bitangent = _normal.cross(_tangent);
+    }
+    bool hit(const Ray& ray, Real t_min, Real t_max,
              HitRecord& r_rec) const override {
-        double denom = _normal.dot(ray.direction());
-        if (std::abs(denom) < std::numeric_limits<double>::epsilon()) {
+        Real denom = _normal.dot(ray.direction());
+        if (std::abs(denom) < std::numeric_limits<Real>::epsilon()) {
             // Ray is parallel to the plane
             return false;
         }
 
-        Vec3d oc = _center - ray.origin();
-        double t = oc.dot(_normal) / denom;
+        Vec3 oc = _center - ray.origin();
+        Real t = oc.dot(_normal) / denom;
 
-        if (t < t_min || t > t_max) {
+        if (t <= t_min || t > t_max) {
             // Intersection is outside the valid range
             return false;
         }
 
         r_rec.t = t;
-        r_rec.point = ray.at(t);
+        r_rec.point = project(ray.at(t), _center, _normal);
+        r_rec.error = plane_error(r_rec.point, _center);
         r_rec.set_face_normal(ray, _normal);
-        r_rec.material = _material;
+        r_rec.material = _material.get();
+        r_rec.object = this;
+        r_rec.time = ray.time();
+        Vec3 d = r_rec.point - _center;
+        r_rec.u = d.dot(_tangent);
+        r_rec.v = d.dot(_bitangent);
+        r_rec.uv_length = 1;
 
         return true;
     }
@@ -39,58 +76,95 @@ class Plane : public Geometry {
 
 class Rectangle : public Geometry {
    private:
-    std::array<Point3d, 4> _vertices;
-    Vec3d _normal;
+    std::array<Point3, 4> _vertices;
+    Vec3 _normal;  // Unit length
 
    public:
-    Rectangle(std::array<Point3d, 4> vertices, const Vec3d& normal,
+    Rectangle(std::array<Point3, 4> vertices, const Vec3& normal,
               shared_ptr<Material> material)
-        : Geometry(material), _normal(normal) {
+        : Geometry(material), _normal(normal.unit_vector()) {
         _vertices[0] = vertices[0];
         _vertices[1] = vertices[1];
         _vertices[2] = vertices[2];
         _vertices[3] = vertices[3];
     }
 
-    bool hit(const Ray& ray, double t_min, double t_max,
+    bool hit(const Ray& ray, Real t_min, Real t_max,
              HitRecord& r_rec) const override {
-        Vec3d op = _vertices[0] - ray.origin();
-        double denom = ray.direction().dot(_normal);
+        Vec3 op = _vertices[0] - ray.origin();
+        Real denom = ray.direction().dot(_normal);
 
-        if (std::abs(denom) < std::numeric_limits<double>::epsilon()) {
+        if (std::abs(denom) < std::numeric_limits<Real>::epsilon()) {
             // Ray is parallel to the plane
             return false;
         }
 
-        double t = op.dot(_normal) / denom;
+        Real t = op.dot(_normal) / denom;
 
-        if (t < t_min || t > t_max) {
+        if (t <= t_min || t > t_max) {
             return false;
         }
 
-        Vec3d hitPoint = ray.at(t);
+        Vec3 hitPoint = project(ray.at(t), _vertices[0], _normal);
         if (!insideRectangle(hitPoint)) {
             return false;
         }
 
         r_rec.t = t;
         r_rec.point = hitPoint;
+        r_rec.error = plane_error(hitPoint, _vertices[0]);
         r_rec.set_face_normal(ray, _normal);
-        r_rec.material = _material;
+        r_rec.material = _material.get();
+        r_rec.object = this;
+        r_rec.time = ray.time();
+        // Coordinates along the edges leaving vertex 0.
+        Vec3 e1 = _vertices[1] - _vertices[0];
+        Vec3 e3 = _vertices[3] - _vertices[0];
+        Vec3 d = hitPoint - _vertices[0];
+        r_rec.u = d.dot(e1) / e1.length_squared();
+        r_rec.v = d.dot(e3) / e3.length_squared();
+        r_rec.uv_length = sqrt(e1.length() * e3.length());
+        return true;
+    }
+
+    bool bounding_box(AABB& output_box) const override {
+        output_box = AABB();
+        for (const auto& vertex : _vertices) output_box.expand(vertex);
+        // Pad so the box of an axis aligned rectangle is not flat.
+        Vec3 pad{1e-4, 1e-4, 1e-4};
+        output_box = AABB(output_box.min - pad, output_box.max + pad);
         return true;
     }
 
+    Real area() const override {
+        return (_vertices[1] - _vertices[0])
+            .cross(_vertices[3] - _vertices[0])
+            .length();
+    }
+
+    Real normal_bounds(Vec3& axis) const override {
+        axis = _normal;
+        return 1;
+    }
+
+    Point3 sample_point(Vec3& normal, Real) const override {
+        normal = _normal;
+        return _vertices[0] +
+               Math::random_double() * (_vertices[1] - _vertices[0]) +
+               Math::random_double() * (_vertices[3] - _vertices[0]);
+    }
+
    private:
-    bool insideRectangle(const Point3d& point) const {
-        Vec3d edges[4] = {
+    bool insideRectangle(const Point3& point) const {
+        Vec3 edges[4] = {
             _vertices[1] - _vertices[0], _vertices[2] - _vertices[1],
             _vertices[3] - _vertices[2], _vertices[0] - _vertices[3]};
 
-        Vec3d vectors[4] = {point - _vertices[0], point - _vertices[1],
+        Vec3 vectors[4] = {point - _vertices[0], point - _vertices[1],
                             point - _vertices[2], point - _vertices[3]};
 
         for (int i = 0; i < 4; ++i) {
-            Vec3d cross = edges[i].cross(vectors[i]);
+            Vec3 cross = edges[i].cross(vectors[i]);
             if (cross.dot(_normal) >= 0) {
                 return false;
             }
@@ -4,36 +4,79 @@
 
 class Sphere : public Geometry {
    private:
-    Point3d _center;
-    double _radius;
+    Point3 _center;
+    Real _radius;
 
    public:
-    Sphere(Point3d center, double radius, shared_ptr<Material> material)
+    Sphere(Point3 center, Real radius, shared_ptr<Material> material)
         : Geometry(material), _center(center), _radius(radius) {}
-    bool hit(const Ray& ray, double t_min, double t_max,
+    bool hit(const Ray& ray, Real t_min, Real t_max,
              HitRecord& r_rec) const override {
-        Vec3d oc = ray.origin() - _center;
-        double a = ray.direction().length_squared();
-        double half_b = oc.dot(ray.direction());
-        double c = oc.length_squared() - _radius * _radius;
+        Vec3 oc = ray.origin() - _center;
+        Real a = ray.direction().length_squared();
+        Real half_b = oc.dot(ray.direction());
+        Real c = oc.length_squared() - _radius * _radius;
 
-        double discriminant = half_b * half_b - a * c;
-        if (discriminant < 0) return false;
-        double sqrtd = sqrt(discriminant);
+        // The discriminant from the distance between the center and the
+        // line, and the roots without cancellation, keep distant and
+        // grazing hits accurate in float (Ray Tracing Gems, chapter 7).
+        Real k = half_b / a, l2 = 0;
+        for (size_t i = 0; i < 3; ++i) {
+            Real l = oc[i] - k * ray.direction()[i];
+            l2 += l * l;
+        }
+        Real discriminant = a * (_radius * _radius - l2);
+        if (discriminant <= 0) return false;
+        Real q = -(half_b + std::copysign(sqrt(discriminant), half_b));
+        Real t0 = c / q, t1 = q / a;
+        if (t0 > t1) std::swap(t0, t1);
 
         // Find the nearest root that lies in the acceptable range.
-        double root = (-half_b - sqrtd) / a;
-        if (root < t_min || t_max < root) {
-            root = (-half_b + sqrtd) / a;
-            if (root < t_min || t_max < root) return false;
+        Real root = t0;
+        if (root <= t_min || t_max < root) {
+            root = t1;
+            if (root <= t_min || t_max < root) return false;
         }
 
         r_rec.t = root;
-        r_rec.point = ray.at(r_rec.t);
-        Vec3d outward_normal = (r_rec.point - _center) / _radius;
+        // Project the hit back onto the sphere, which leaves an error of a
+        // few ulps of its coordinates.
+        Vec3 offset = ray.at(root) - _center;
+        offset = offset * (_radius / offset.length());
+        r_rec.point = _center + offset;
+        r_rec.error =
+            Math::gamma(6) * (Math::abs(offset) + Math::abs(_center));
+        Vec3 outward_normal = offset / _radius;
         r_rec.set_face_normal(ray, outward_normal);
-        r_rec.material = _material;
+        r_rec.material = _material.get();
+        r_rec.object = this;
+        r_rec.time = ray.time();
+        set_uv(outward_normal, r_rec);
 
         return true;
     }
+
+    bool bounding_box(AABB& output_box) const override {
+        Vec3 r{_radius, _radius, _radius};
+        output_box = AABB(_center - r, _center + r);
+        return true;
+    }
+
+    Real area() const override { return 4 * Math::PI * _radius * _radius; }
+
+    Point3 sample_point(Vec3& normal, Real) const override {
+        normal = Math::random_unit_vector();
+        return _center + _radius * normal;
+    }
+
+   private:
+    // Longitude and latitude of a point on the unit sphere, with v running
+    // from -y to +y.
+    void set_uv(const Vec3& p, HitRecord& r_rec) const {
+        Real theta = acos(Math::clamp(-p.y(), -1, 1));
+        Real phi = atan2(-p.z(), p.x()) + Math::PI;
+        r_rec.u = phi / (2 * Math::PI);
+        r_rec.v = theta / Math::PI;
+        r_rec.uv_length = Math::PI * _radius * sqrt(2.0);
+    }
 };
\ No newline at end of file
@@ -0,0 +1,315 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+#include "AABB.h"
+#include "Common.h"
+#include "MathUtils.h"
+#include "Vector.h"
+
+// Add to an atomic double without a lock.
+inline void atomic_add(std::atomic<double>& target, double value) {
+    double current = target.load(std::memory_order_relaxed);
+    while (!target.compare_exchange_weak(current, current + value,
+                                         std::memory_order_relaxed)) {
+    }
+}
+
+// Directional distribution over the sphere, stored as a quadtree over the
+// cylindrical (cos theta, phi) square. That mapping preserves area, so a
+// density p on the square is p / (4 pi) per steradian.
+class DTree {
+   private:
+    struct Node {
+        std::array<std::atomic<double>, 4> sums;
+        std::array<int, 4> children;  // 0 marks a leaf quadrant
+
+        Node() {
+            for (int i = 0; i < 4; ++i) {
+                sums[i] = 0;
+                children[i] = 0;
+            }
+        }
+        Node(const Node& other) : children(other.children) {
+            for (int i = 0; i < 4; ++i) {
+                sums[i] = other.sums[i].load(std::memory_order_relaxed);
+            }
+        }
+        Node& operator=(const Node& other) {
+            children = other.children;
+            for (int i = 0; i < 4; ++i) {
+                sums[i] = other.sums[i].load(std::memory_order_relaxed);
+            }
+            return *this;
+        }
+
+        double total() const {
+            return sums[0] + sums[1] + sums[2] + sums[3];
+        }
+    };
+
+    vector<Node> _nodes = vector<Node>(1);
+
+   public:
+    static constexpr int MAX_DEPTH = 20;
+
+    double total() const { return _nodes[0].total(); }
+
+    // Deposit a radiance estimate arriving from direction. Threads may call
+    // this concurrently; the tree's shape does not change during a pass.
+    void record(const Vec3& direction, double value) {
+        if (!(value > 0) || !std::isfinite(value)) return;
+        double x, y;
+        to_square(direction, x, y);
+        int index = 0;
+        for (;;) {
+            int quadrant = descend(x, y);
+            atomic_add(_nodes[index].sums[quadrant], value);
+            index = _nodes[index].children[quadrant];
+            if (index == 0) break;
+        }
+    }
+
+    // Solid angle density of sample().
+    double pdf(const Vec3& direction) const {
+        if (total() <= 0) return 1 / (4 * Math::PI);
+        double x, y;
+        to_square(direction, x, y);
+        double p = 1;
+        int index = 0;
+        for (;;) {
+            const Node& node = _nodes[index];
+            int quadrant = descend(x, y);
+            double total = node.total();
+            if (total <= 0) break;
+            p *= 4 * node.sums[quadrant] / total;
+            index = node.children[quadrant];
+            if (index == 0) break;
+        }
+        return p / (4 * Math::PI);
+    }
+
+    Vec3 sample() const {
+        double x = Math::random_double(), y = Math::random_double();
+        if (total() <= 0) return from_square(x, y);
+
+        // Pick quadrants in proportion to their energy and remember where the
+        // chosen cell sits in the square.
+        double origin_x = 0, origin_y = 0, size = 1;
+        int index = 0;
+        for (;;) {
+            const Node& node = _nodes[index];
+            double s[4];
+            for (int i = 0; i < 4; ++i) s[i] = node.sums[i];
+            double left = s[0] + s[2];
+            double total = left + s[1] + s[3];
+            if (total <= 0) break;
+
+            int qx = 0, qy = 0;
+            double u = Math::random_double() * total;
+            if (u >= left) {
+                qx = 1;
+                u -= left;
+            }
+            if (u >= s[qx]) qy = 1;
+
+            size *= 0.5;
+            origin_x += qx * size;
+            origin_y += qy * size;
+            index = node.children[qy * 2 + qx];
+            if (index == 0) break;
+        }
+        return from_square(origin_x + x * size, origin_y + y * size);
+    }
+
+    // Next training tree: cells holding more than threshold of the energy
+    // are split, cells below it are merged, and all sums start at zero.
+    DTree refined(double threshold = 0.01) const {
+        DTree result;
+        double total = this->total();
+        if (total <= 0) return result;
+        result._nodes.clear();
+        result._nodes.emplace_back();
+        result.refine_from(*this, 0, 0, total * threshold, 1);
+        return result;
+    }
+
+    static void to_square(const Vec3& direction, double& x, double& y) {
+        Vec3 d = direction.unit_vector();
+        x = Math::clamp((d.z() + 1) * 0.5, 0, 1 - 1e-12);
+        double phi = atan2(d.y(), d.x());
+        if (phi < 0) phi += 2 * Math::PI;
+        y = Math::clamp(phi / (2 * Math::PI), 0, 1 - 1e-12);
+    }
+
+    static Vec3 from_square(double x, double y) {
+        double cos_theta = 2 * x - 1;
+        double sin_theta = sqrt(std::max(0.0, 1 - cos_theta * cos_theta));
+        double phi = 2 * Math::PI * y;
+        return Vec3{sin_theta * cos(phi), sin_theta * sin(phi), cos_theta};
+    }
+
+   private:
+    // Quadrant of (x, y) in the current cell, rescaling (x, y) to it.
+    static int descend(double& x, double& y) {
+        int qx = x >= 0.5, qy = y >= 0.5;
+        x = x * 2 - qx;
+        y = y * 2 - qy;
+        return qy * 2 + qx;
+    }
+
+    // Give node target the children of source's node source_index whose
+    // energy is above threshold. Leaf quadrants above it are split, assuming
+    // their energy is spread evenly.
+    void refine_from(const DTree& source, int source_index, int target,
+                     double threshold, int depth) {
+        for (int i = 0; i < 4; ++i) {
+            double energy = source._nodes[source_index].sums[i];
+            if (energy <= threshold || depth >= MAX_DEPTH) continue;
+            int index = static_cast<int>(_nodes.size());
+            _nodes.emplace_back();
+            _nodes[target].children[i] = index;
+            int child = source._nodes[source_index].children[i];
+            if (child > 0) {
+                refine_from(source, child, index, threshold, depth + 1);
+            } else {
+                split_leaf(index, energy / 4, threshold, depth + 1);
+            }
+        }
+    }
+
+    void split_leaf(int index, double energy, double threshold, int depth) {
+        for (int i = 0; i < 4; ++i) {
+            if (energy > threshold && depth < MAX_DEPTH) {
+                int child = static_cast<int>(_nodes.size());
+                _nodes.emplace_back();
+                _nodes[index].children[i] = child;
+                split_leaf(child, energy / 4, threshold, depth + 1);
+            }
+        }
+    }
+};
+
+// Spatial binary tree over the scene bounds whose leaves each hold a
+// directional distribution of incident radiance, learned online as in
+// "Practical Path Guiding" (Mueller et al. 2017). Training proceeds in passes
+// of doubling sample counts: during a pass paths sample from the previous
+// pass's distributions and splat into the current ones with lock-free
+// atomic adds, and between passes the trees are refined.
+class SDTree {
+   private:
+    struct Node {
+        int axis = 0;
+        int children[2] = {0, 0};  // 0 marks a leaf
+        int leaf = -1;
+    };
+
+    struct Leaf {
+        DTree sampling;
+        DTree building;
+        std::atomic<uint64_t> samples{0};
+
+        Leaf() {}
+        Leaf(const Leaf& other)
+            : sampling(other.sampling), building(other.building),
+              samples(other.samples.load()) {}
+    };
+
+    AABB _bounds;
+    vector<Node> _nodes = vector<Node>(1);
+    vector<Leaf> _leaves = vector<Leaf>(1);
+    int _pass = 0;
+    int _training_passes;
+    double _split_factor;
+
+   public:
+    // A leaf is split once its samples in a pass exceed split_factor times
+    // the square root of the pass's samples per pixel.
+    SDTree(const AABB& bounds, int training_passes = 6,
+           double split_factor = 4000)
+        : _bounds(bounds), _training_passes(training_passes),
+          _split_factor(split_factor) {
+        _nodes[0].leaf = 0;
+    }
+
+    bool training() const { return _pass < _training_passes; }
+
+    // Samples per pixel of the current training pass.
+    int pass_samples() const { return 1 << _pass; }
+
+    // Directional distribution to sample from at point.
+    const DTree& sampling_tree(const Point3& point) const {
+        return _leaves[leaf(point)].sampling;
+    }
+
+    void record(const Point3& point, const Vec3& direction, double value) {
+        if (!training()) return;
+        Leaf& l = _leaves[leaf(point)];
+        l.samples.fetch_add(1, std::memory_order_relaxed);
+        l.building.record(direction, value);
+    }
+
+    // Finish a training pass. Must not run while paths are being traced.
+    void end_pass() {
+        if (!training()) return;
+        double threshold = _split_factor * sqrt(pass_samples());
+        size_t node_count = _nodes.size();
+        for (size_t i = 0; i < node_count; ++i) {
+            if (_nodes[i].leaf >= 0 &&
+                _leaves[_nodes[i].leaf].samples > threshold)
+                split(static_cast<int>(i));
+        }
+        for (auto& l : _leaves) {
+            l.sampling = l.building;
+            l.building = l.sampling.refined();
+            l.samples = 0;
+        }
+        ++_pass;
+    }
+
+   private:
+    int leaf(const Point3& point) const {
+        Vec3 extent = _bounds.max - _bounds.min;
+        double p[3];
+        for (size_t a = 0; a < 3; ++a) {
+            p[a] = extent[a] > 0 ? Math::clamp((point[a] - _bounds.min[a]) /
+                                                   extent[a],
+                                               0, 1)
+                                 : 0.5;
+        }
+        int index = 0;
+        while (_nodes[index].leaf < 0) {
+            const Node& node = _nodes[index];
+            double& x = p[node.axis];
+            int side = x >= 0.5;
+            x = x * 2 - side;
+            index = node.children[side];
+        }
+        return _nodes[index].leaf;
+    }
+
+    // Halve a leaf along the axis after its parent's; both halves start
+    // from a copy of its distributions.
+    void split(int index) {
+        int parent_leaf = _nodes[index].leaf;
+        int axis = (_nodes[index].axis + 1) % 3;
+        for (int side = 0; side < 2; ++side) {
+            Node child;
+            child.axis = axis;
+            if (side == 0) {
+                child.leaf = parent_leaf;
+            } else {
+                child.leaf = static_cast<int>(_leaves.size());
+                Leaf copy = _leaves[parent_leaf];
+                _leaves.push_back(copy);
+            }
+            _nodes[index].children[side] = static_cast<int>(_nodes.size());
+            _nodes.push_back(child);
+        }
+        _nodes[index].leaf = -1;
+        _nodes[index].axis = axis;
+    }
+};
@@ -8,9 +8,9 @@
 #include "Pixel.h"
 #include "Vector.h"
 
-using Color = Vec3d;
+using Color = Vec3;
 
-Color from_hex(const std::string& hexColor) {
+inline Color from_hex(const std::string& hexColor) {
     std::istringstream iss(hexColor.substr(1));
     int hexValue;
     iss >> std::hex >> hexValue;
@@ -21,6 +21,11 @@ Color from_hex(const std::string& hexColor) {
     return {r, g, b};
 }
 
+// Relative luminance of linear sRGB.
+inline Real luminance(const Color& c) {
+    return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+}
+
 template <typename T>
 Vec<T, 3> color_to_rgb(Color pixel_color, int samples_per_pixel) {
     // Divide the color by the number of samples and gamma-correct for
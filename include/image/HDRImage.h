@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include "Color.h"
+#include "Common.h"
+
+// Linear, unclamped RGB image. Rows are stored top to bottom, the same
+// order as Image::data.
+class HDR_Image {
+   public:
+    int width = 0;
+    int height = 0;
+    vector<Color> data;
+
+   public:
+    HDR_Image() {}
+    HDR_Image(int width, int height)
+        : width(width), height(height), data(width * height) {}
+
+    Color& at(int x, int y) { return data[y * width + x]; }
+    const Color& at(int x, int y) const { return data[y * width + x]; }
+
+    // Portable float map, little endian, rows stored bottom to top.
+    static HDR_Image read_pfm(const std::string& filename) {
+        std::ifstream infile(filename, std::ios::binary);
+        if (!infile) throw std::runtime_error("Cannot open " + filename);
+
+        std::string magic;
+        int w, h;
+        double scale;
+        infile >> magic >> w >> h >> scale;
+        infile.get();
+        if (magic != "PF" && magic != "Pf")
+            throw std::runtime_error("Not a PFM file: " + filename);
+        if (scale > 0)
+            throw std::runtime_error("Big endian PFM is not supported");
+
+        int channels = magic == "PF" ? 3 : 1;
+        HDR_Image image(w, h);
+        vector<float> row(w * channels);
+        for (int y = h - 1; y >= 0; --y) {
+            infile.read(reinterpret_cast<char*>(row.data()),
+                        row.size() * sizeof(float));
+            if (!infile) throw std::runtime_error("Truncated PFM: " + filename);
+            for (int x = 0; x < w; ++x) {
+                const float* p = &row[x * channels];
+                image.at(x, y) = channels == 3 ? Color{p[0], p[1], p[2]}
+                                               : Color{p[0], p[0], p[0]};
+            }
+        }
+        return image;
+    }
+
+    // Radiance RGBE, flat or run length encoded, in the standard -Y +X
+    // orientation.
+    static HDR_Image read_hdr(const std::string& filename) {
+        std::ifstream infile(filename, std::ios::binary);
+        if (!infile) throw std::runtime_error("Cannot open " + filename);
+
+        std::string line;
+        std::getline(infile, line);
+        if (line.rfind("#?", 0) != 0)
+            throw std::runtime_error("Not a Radiance HDR file: " + filename);
+        while (std::getline(infile, line) && !line.empty()) {
+            if (line.rfind("FORMAT=", 0) == 0 &&
+                line != "FORMAT=32-bit_rle_rgbe")
+                throw std::runtime_error("Unsupported HDR format: " + line);
+        }
+        std::string y_axis, x_axis;
+        int w, h;
+        infile >> y_axis >> h >> x_axis >> w;
+        infile.get();
+        if (y_axis != "-Y" || x_axis != "+X")
+            throw std::runtime_error("Unsupported HDR orientation");
+
+        HDR_Image image(w, h);
+        vector<uint8_t> scanline(w * 4);
+        for (int y = 0; y < h; ++y) {
+            read_rgbe_scanline(infile, scanline, w);
+            for (int x = 0; x < w; ++x) {
+                const uint8_t* p = &scanline[x * 4];
+                double f = p[3] ? std::ldexp(1.0, p[3] - (128 + 8)) : 0.0;
+                image.at(x, y) = Color{p[0] * f, p[1] * f, p[2] * f};
+            }
+        }
+        return image;
+    }
+
+    // 8 bit PPM, ascii or binary. Values are decoded with the gamma of 2
+    // color_to_rgb encodes with.
+    static HDR_Image read_ppm(const std::string& filename) {
+        std::ifstream infile(filename, std::ios::binary);
+        if (!infile) throw std::runtime_error("Cannot open " + filename);
+
+        std::string magic;
+        int w, h, max_value;
+        infile >> magic >> w >> h >> max_value;
+        infile.get();
+        if ((magic != "P3" && magic != "P6") || max_value <= 0 ||
+            max_value > 255)
+            throw std::runtime_error("Unsupported PPM file: " + filename);
+
+        HDR_Image image(w, h);
+        for (auto& c : image.data) {
+            for (size_t i = 0; i < 3; ++i) {
+                int value;
+                if (magic == "P3") {
+                    infile >> value;
+                } else {
+                    value = infile.get();
+                }
+                double x = static_cast<double>(value) / max_value;
+                c[i] = x * x;
+            }
+        }
+        if (!infile) throw std::runtime_error("Truncated PPM: " + filename);
+        return image;
+    }
+
+    // Pick the reader from the file extension.
+    static HDR_Image read(const std::string& filename) {
+        std::string ext = filename.substr(filename.find_last_of('.') + 1);
+        if (ext == "pfm") return read_pfm(filename);
+        if (ext == "hdr") return read_hdr(filename);
+        if (ext == "ppm") return read_ppm(filename);
+        throw std::runtime_error("Unknown HDR image format: " + filename);
+    }
+
+    void write_pfm(const std::string& filename) const {
+        std::ofstream outfile(filename, std::ios::binary);
+        if (!outfile) throw std::runtime_error("Cannot write " + filename);
+        outfile << "PF\n" << width << ' ' << height << "\n-1.0\n";
+        vector<float> row(width * 3);
+        for (int y = height - 1; y >= 0; --y) {
+            for (int x = 0; x < width; ++x) {
+                const Color& c = at(x, y);
+                row[x * 3 + 0] = static_cast<float>(c.x());
+                row[x * 3 + 1] = static_cast<float>(c.y());
+                row[x * 3 + 2] = static_cast<float>(c.z());
+            }
+            outfile.write(reinterpret_cast<const char*>(row.data()),
+                          row.size() * sizeof(float));
+        }
+    }
+
+   private:
+    static void read_rgbe_scanline(std::ifstream& infile,
+                                   vector<uint8_t>& scanline, int w) {
+        uint8_t head[4];
+        infile.read(reinterpret_cast<char*>(head), 4);
+        bool rle = w >= 8 && w < 32768 && head[0] == 2 && head[1] == 2 &&
+                   ((head[2] << 8) | head[3]) == w;
+        if (!rle) {
+            std::memcpy(scanline.data(), head, 4);
+            infile.read(reinterpret_cast<char*>(scanline.data() + 4),
+                        (w - 1) * 4);
+        } else {
+            // Each channel is run length encoded separately.
+            for (int c = 0; c < 4; ++c) {
+                int x = 0;
+                while (x < w) {
+                    int count = infile.get();
+                    if (count > 128) {
+                        count -= 128;
+                        uint8_t value = static_cast<uint8_t>(infile.get());
+                        if (x + count > w)
+                            throw std::runtime_error("Corrupt HDR run");
+                        for (int i = 0; i < count; ++i)
+                            scanline[(x++) * 4 + c] = value;
+                    } else {
+                        if (count <= 0 || x + count > w)
+                            throw std::runtime_error("Corrupt HDR run");
+                        for (int i = 0; i < count; ++i)
+                            scanline[(x++) * 4 + c] =
+                                static_cast<uint8_t>(infile.get());
+                    }
+                }
+            }
+        }
+        if (!infile) throw std::runtime_error("Truncated HDR file");
+    }
+};
@@ -6,6 +6,7 @@
 
 #include "Common.h"
 #include "Pixel.h"
+#include "Trace.h"
 
 struct ImageOption {
     int width;
@@ -36,6 +37,7 @@ class PPM_Image : public Image {
     PPM_Image(ImageOption option, const std::string& filename)
         : Image(option), _filename(filename) {}
     void write() override {
+        TRACE_SCOPE("Image::write");
         std::ofstream outfile(_filename);
         outfile << "P3\n" << width << ' ' << height << '\n' << 255 << '\n';
         for (const auto& row : data) {
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Color.h"
+#include "Common.h"
+#include "Vector.h"
+
+// Radiance arriving from infinitely far away, seen by rays that leave the
+// scene.
+class Background {
+   public:
+    virtual ~Background() = default;
+
+    virtual Color radiance(const Vec3& direction) const = 0;
+
+    // Backgrounds that can be importance sampled are also used for next
+    // event estimation at diffuse hits.
+    virtual bool can_sample() const { return false; }
+
+    // Sample a unit direction towards the background. Returns its radiance
+    // and sets pdf (solid angle), or 0 if the sample failed.
+    virtual Color sample(Vec3& direction, Real& pdf) const {
+        pdf = 0;
+        return Color{0, 0, 0};
+    }
+
+    virtual Real pdf(const Vec3& direction) const { return 0; }
+};
+
+using BackgroundPtr = shared_ptr<Background>;
+
+// The same radiance from every direction, e.g. black for scenes lit by
+// their emitters alone.
+class UniformBackground : public Background {
+   private:
+    Color _radiance;
+
+   public:
+    UniformBackground(const Color& radiance) : _radiance(radiance) {}
+
+    Color radiance(const Vec3& direction) const override { return _radiance; }
+};
+
+// White to blue gradient along y.
+class GradientSky : public Background {
+   public:
+    Color radiance(const Vec3& direction) const override {
+        Vec3 unit_direction = direction.unit_vector();
+        auto t = 0.5 * (unit_direction.y() + 1.0);
+        return (1.0 - t) * Color{1.0, 1.0, 1.0} + t* Color{0.5, 0.7, 1.0};
+    }
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+
+#include "Background.h"
+#include "HDRImage.h"
+#include "MathUtils.h"
+
+// Lat-long environment map with y up. Directions are sampled in proportion
+// to texel luminance through a marginal row CDF and per row column CDFs, so
+// small bright regions such as the sun are found by light sampling.
+class EnvironmentMap : public Background {
+   private:
+    HDR_Image _image;
+    double _scale;
+    vector<double> _row_cdf;     // height + 1 entries
+    vector<double> _column_cdf;  // height rows of width + 1 entries
+    double _total_weight = 0;
+
+   public:
+    EnvironmentMap(HDR_Image image, double scale = 1.0)
+        : _image(std::move(image)), _scale(scale) {
+        int w = _image.width, h = _image.height;
+        _row_cdf.assign(h + 1, 0.0);
+        _column_cdf.assign(h * (w + 1), 0.0);
+        for (int y = 0; y < h; ++y) {
+            // Rows near the poles cover less solid angle.
+            double sin_theta = sin(Math::PI * (y + 0.5) / h);
+            double* cdf = &_column_cdf[y * (w + 1)];
+            for (int x = 0; x < w; ++x) {
+                cdf[x + 1] = cdf[x] + texel_weight(x, y, sin_theta);
+            }
+            _row_cdf[y + 1] = _row_cdf[y] + cdf[w];
+        }
+        _total_weight = _row_cdf[h];
+    }
+
+    Color radiance(const Vec3& direction) const override {
+        int x, y;
+        texel(direction.unit_vector(), x, y);
+        return _scale * _image.at(x, y);
+    }
+
+    bool can_sample() const override { return _total_weight > 0; }
+
+    Color sample(Vec3& direction, Real& pdf) const override {
+        int w = _image.width, h = _image.height;
+        int y = pick(&_row_cdf[0], h, Math::random_double() * _total_weight);
+        const double* cdf = &_column_cdf[y * (w + 1)];
+        int x = pick(cdf, w, Math::random_double() * cdf[w]);
+
+        double u = (x + Math::random_double()) / w;
+        double v = (y + Math::random_double()) / h;
+        double theta = v * Math::PI, phi = u * 2 * Math::PI - Math::PI;
+        double sin_theta = sin(theta);
+        direction = Vec3{sin_theta * cos(phi), cos(theta),
+                         sin_theta * sin(phi)};
+        pdf = texel_pdf(x, y, sin_theta);
+        return pdf > 0 ? _scale * _image.at(x, y) : Color{0, 0, 0};
+    }
+
+    Real pdf(const Vec3& direction) const override {
+        if (!can_sample()) return 0;
+        Vec3 d = direction.unit_vector();
+        int x, y;
+        texel(d, x, y);
+        double sin_theta = sqrt(std::max<double>(0, 1 - d.y() * d.y()));
+        return texel_pdf(x, y, sin_theta);
+    }
+
+   private:
+    double texel_weight(int x, int y, double sin_theta) const {
+        return std::max<double>(luminance(_image.at(x, y)), 0) * sin_theta;
+    }
+
+    // Solid angle density of sampling direction in texel (x, y).
+    double texel_pdf(int x, int y, double sin_theta) const {
+        if (sin_theta <= 0) return 0;
+        int w = _image.width, h = _image.height;
+        double row_sin = sin(Math::PI * (y + 0.5) / h);
+        double p = texel_weight(x, y, row_sin) / _total_weight;
+        return p * w * h / (2 * Math::PI * Math::PI * sin_theta);
+    }
+
+    void texel(const Vec3& d, int& x, int& y) const {
+        double u = (atan2(d.z(), d.x()) + Math::PI) / (2 * Math::PI);
+        double v = acos(Math::clamp(d.y(), -1, 1)) / Math::PI;
+        x = std::min(static_cast<int>(u * _image.width), _image.width - 1);
+        y = std::min(static_cast<int>(v * _image.height), _image.height - 1);
+    }
+
+    // Index i in [0, n) with cdf[i] <= value < cdf[i + 1], skipping empty
+    // entries.
+    static int pick(const double* cdf, int n, double value) {
+        int i = static_cast<int>(std::upper_bound(cdf, cdf + n + 1, value) -
+                                 cdf) - 1;
+        i = std::clamp(i, 0, n - 1);
+        while (i > 0 && cdf[i + 1] == cdf[i]) --i;
+        return i;
+    }
+};
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <unordered_map>
+
+#include "AABB.h"
+#include "Color.h"
+#include "Common.h"
+#include "Geometry.h"
+#include "Material.h"
+
+// What a group of emitters can contribute to a point, conservatively: where
+// they are, how much they emit, and the directions they emit into. Normals
+// lie within theta_o of axis and light leaves up to theta_e past them.
+struct LightBounds {
+    AABB bounds;
+    Real power = 0;
+    Vec3 axis{0, 0, 1};
+    Real cos_theta_o = 1;
+    Real cos_theta_e = 1;
+
+    // Upper estimate of the light reaching point p on a surface with normal
+    // n, up to a constant. n may be zero for points in free space. This is
+    // the importance measure of Conty Estevez and Kulla, "Importance
+    // Sampling of Many Lights with Adaptive Tree Splitting".
+    Real importance(const Point3& p, const Vec3& n) const {
+        Vec3 to_point = p - bounds.center();
+        Real distance2 = to_point.length_squared();
+        Real radius = 0.5 * (bounds.max - bounds.min).length();
+        // Keep points in or near the bounds from blowing up, as pbrt does.
+        Real d2 = std::max(distance2, radius);
+        Vec3 wi = distance2 > 0 ? to_point / std::sqrt(distance2)
+                                : Vec3{0, 0, 1};
+
+        // Angle the bounds subtend from p.
+        Real cos_b = -1;
+        if (distance2 > radius * radius)
+            cos_b = safe_sqrt(1 - radius * radius / distance2);
+        Real sin_b = safe_sqrt(1 - cos_b * cos_b);
+
+        // Smallest angle between the emission cone and the direction to p.
+        Real cos_w = axis.dot(wi);
+        Real sin_w = safe_sqrt(1 - cos_w * cos_w);
+        Real sin_o = safe_sqrt(1 - cos_theta_o * cos_theta_o);
+        Real cos_x = cos_sub_clamped(sin_w, cos_w, sin_o, cos_theta_o);
+        Real sin_x = sin_sub_clamped(sin_w, cos_w, sin_o, cos_theta_o);
+        Real cos_p = cos_sub_clamped(sin_x, cos_x, sin_b, cos_b);
+        if (cos_p <= cos_theta_e) return 0;
+
+        Real importance = power * cos_p / d2;
+        if (n.length_squared() > 0) {
+            // Smallest angle between the normal and the bounds.
+            Real cos_i = std::fabs(wi.dot(n)) / n.length();
+            Real sin_i = safe_sqrt(1 - cos_i * cos_i);
+            importance *= cos_sub_clamped(sin_i, cos_i, sin_b, cos_b);
+        }
+        return std::max<Real>(importance, 0);
+    }
+
+    static LightBounds merge(const LightBounds& a, const LightBounds& b) {
+        if (a.power <= 0) return b;
+        if (b.power <= 0) return a;
+        LightBounds result;
+        result.bounds = a.bounds;
+        result.bounds.expand(b.bounds);
+        result.power = a.power + b.power;
+        result.cos_theta_e = std::min(a.cos_theta_e, b.cos_theta_e);
+
+        // Smallest cone holding both normal cones.
+        Real theta_a = std::acos(Math::clamp(a.cos_theta_o, -1, 1));
+        Real theta_b = std::acos(Math::clamp(b.cos_theta_o, -1, 1));
+        Real theta_d = std::acos(Math::clamp(a.axis.dot(b.axis), -1, 1));
+        result.axis = a.axis;
+        if (std::min<Real>(theta_d + theta_b, Math::PI) <= theta_a) {
+            result.cos_theta_o = a.cos_theta_o;
+            return result;
+        }
+        if (std::min<Real>(theta_d + theta_a, Math::PI) <= theta_b) {
+            result.axis = b.axis;
+            result.cos_theta_o = b.cos_theta_o;
+            return result;
+        }
+        Real theta_o = 0.5 * (theta_a + theta_d + theta_b);
+        Vec3 normal = a.axis.cross(b.axis);
+        if (theta_o >= Math::PI || normal.length_squared() == 0) {
+            result.cos_theta_o = -1;
+            return result;
+        }
+        // Rotate a's axis towards b's by theta_o - theta_a.
+        Real angle = theta_o - theta_a;
+        Vec3 k = normal.unit_vector();
+        result.axis = (a.axis * std::cos(angle) +
+                       k.cross(a.axis) * std::sin(angle) +
+                       k * (k.dot(a.axis) * (1 - std::cos(angle))))
+                          .unit_vector();
+        result.cos_theta_o = std::cos(theta_o);
+        return result;
+    }
+
+   private:
+    static Real safe_sqrt(Real x) { return std::sqrt(std::max<Real>(x, 0)); }
+
+    // cos(max(0, a - b)) and sin(max(0, a - b)) from sines and cosines.
+    static Real cos_sub_clamped(Real sin_a, Real cos_a, Real sin_b,
+                                Real cos_b) {
+        if (cos_a > cos_b) return 1;
+        return cos_a * cos_b + sin_a * sin_b;
+    }
+
+    static Real sin_sub_clamped(Real sin_a, Real cos_a, Real sin_b,
+                                Real cos_b) {
+        if (cos_a > cos_b) return 0;
+        return sin_a * cos_b - cos_a * sin_b;
+    }
+};
+
+// Hierarchy over the emitters of a scene for next event estimation. A light
+// is picked by walking down from the root and choosing each child in
+// proportion to its importance for the shading point, so lights that are
+// near, bright and facing it are picked most often, at a cost logarithmic
+// in the number of lights. Nodes are stored depth first like BVH and split
+// the same way, at the median along the longest axis.
+class LightBVH {
+   private:
+    struct Node {
+        LightBounds bounds;
+        int light;  // Light of a leaf, -1 for interior nodes
+        int right;  // Right child of an interior node, the left one is next
+    };
+
+    vector<Node> _nodes;
+    vector<shared_ptr<Geometry>> _lights;
+    // Path from the root to each light's leaf, one bit per level starting
+    // with the lowest, set where the path goes right.
+    vector<uint64_t> _trails;
+    std::unordered_map<const Geometry*, int> _index;
+
+   public:
+    LightBVH() {}
+
+    explicit LightBVH(const vector<shared_ptr<Geometry>>& emitters) {
+        vector<LightBounds> bounds;
+        for (const auto& emitter : emitters) {
+            LightBounds b = light_bounds(*emitter);
+            if (b.power <= 0) continue;
+            _index[emitter.get()] = static_cast<int>(_lights.size());
+            _lights.push_back(emitter);
+            bounds.push_back(b);
+        }
+        if (_lights.empty()) return;
+
+        _trails.resize(_lights.size());
+        vector<int> order(_lights.size());
+        std::iota(order.begin(), order.end(), 0);
+        _nodes.reserve(2 * _lights.size());
+        build(bounds, order, 0, static_cast<int>(order.size()), 0, 0);
+    }
+
+    bool empty() const { return _lights.empty(); }
+    size_t size() const { return _lights.size(); }
+
+    // Pick a light for point p with surface normal n. Sets pmf to the
+    // probability of the pick. Returns null if no light can reach p.
+    const Geometry* sample(const Point3& p, const Vec3& n, Real u,
+                           Real& pmf) const {
+        pmf = 0;
+        if (_nodes.empty()) return nullptr;
+        int index = 0;
+        Real probability = 1;
+        if (_nodes[0].bounds.importance(p, n) <= 0) return nullptr;
+        while (_nodes[index].light < 0) {
+            const Node& node = _nodes[index];
+            Real left = _nodes[index + 1].bounds.importance(p, n);
+            Real right = _nodes[node.right].bounds.importance(p, n);
+            if (left + right <= 0) return nullptr;
+            Real p_left = left / (left + right);
+            if (u < p_left) {
+                index = index + 1;
+                probability *= p_left;
+                u = std::min<Real>(u / p_left, 1 - 1e-7);
+            } else {
+                index = node.right;
+                probability *= 1 - p_left;
+                u = std::min<Real>((u - p_left) / (1 - p_left), 1 - 1e-7);
+            }
+        }
+        pmf = probability;
+        return _lights[_nodes[index].light].get();
+    }
+
+    // Probability that sample picks light for p and n, 0 if light is not
+    // one of the emitters.
+    Real pmf(const Point3& p, const Vec3& n, const Geometry* light) const {
+        auto it = _index.find(light);
+        if (it == _index.end()) return 0;
+        if (_nodes[0].bounds.importance(p, n) <= 0) return 0;
+        uint64_t trail = _trails[it->second];
+        int index = 0;
+        Real probability = 1;
+        while (_nodes[index].light < 0) {
+            const Node& node = _nodes[index];
+            Real left = _nodes[index + 1].bounds.importance(p, n);
+            Real right = _nodes[node.right].bounds.importance(p, n);
+            if (left + right <= 0) return 0;
+            if (trail & 1) {
+                probability *= right / (left + right);
+                index = node.right;
+            } else {
+                probability *= left / (left + right);
+                index = index + 1;
+            }
+            trail >>= 1;
+        }
+        return probability;
+    }
+
+    // Bounds of a single emitter. Power is its luminance integrated over
+    // the hemisphere and the surface.
+    static LightBounds light_bounds(const Geometry& emitter) {
+        LightBounds b;
+        HitRecord rec;
+        rec.front_face = true;
+        if (!emitter.material() || !emitter.bounding_box(b.bounds)) return b;
+        b.power = Math::PI * emitter.area() *
+                  luminance(emitter.material()->emitted(rec));
+        b.cos_theta_o = emitter.normal_bounds(b.axis);
+        b.cos_theta_e = 0;  // Diffuse emission
+        return b;
+    }
+
+   private:
+    int build(const vector<LightBounds>& bounds, vector<int>& order,
+              int begin, int end, uint64_t trail, int depth) {
+        int index = static_cast<int>(_nodes.size());
+        _nodes.push_back({});
+        if (end - begin == 1) {
+            _nodes[index].bounds = bounds[order[begin]];
+            _nodes[index].light = order[begin];
+            _trails[order[begin]] = trail;
+            return index;
+        }
+
+        AABB centers;
+        for (int i = begin; i < end; ++i)
+            centers.expand(bounds[order[i]].bounds.center());
+        int axis = centers.longest_axis();
+        int mid = begin + (end - begin) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + mid,
+                         order.begin() + end, [&](int a, int b) {
+                             return bounds[a].bounds.center()[axis] <
+                                    bounds[b].bounds.center()[axis];
+                         });
+        build(bounds, order, begin, mid, trail, depth + 1);
+        int right = build(bounds, order, mid, end,
+                          trail | (uint64_t(1) << depth), depth + 1);
+        _nodes[index].light = -1;
+        _nodes[index].right = right;
+        _nodes[index].bounds = LightBounds::merge(_nodes[index + 1].bounds,
+                                                  _nodes[right].bounds);
+        return index;
+    }
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "Material.h"
+
+// Emits constant radiance from its front side and absorbs all light.
+class DiffuseLight : public Material {
+   private:
+    Color _emit;
+
+   public:
+    DiffuseLight(const Color& emit) : _emit(emit) {}
+
+    bool scatter(const Ray& ray, const HitRecord& rec, Color& attenuation,
+                 Ray& scattered) const override {
+        return false;
+    }
+
+    bool is_specular() const override { return false; }
+
+    Color emitted(const HitRecord& rec) const override {
+        return rec.front_face ? _emit : Color{0, 0, 0};
+    }
+
+    bool is_emissive() const override { return true; }
+
+    Color albedo(const HitRecord& rec) const override { return _emit; }
+
+    const Color& emit() const { return _emit; }
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Material.h"
+
+// Phase function of a participating medium that scatters light equally in
+// all directions. albedo is the fraction of light a collision scatters
+// rather than absorbs.
+class Isotropic : public Material {
+   private:
+    Color _albedo;
+
+   public:
+    Isotropic(const Color& albedo) : _albedo(albedo) {}
+
+    bool scatter(const Ray& ray, const HitRecord& rec, Color& attenuation,
+                 Ray& scattered) const override {
+        scattered = rec.spawn_ray(Math::random_unit_vector());
+        attenuation = _albedo;
+        return true;
+    }
+
+    bool is_specular() const override { return false; }
+    bool is_volume() const override { return true; }
+
+    Color eval(const Ray& ray, const HitRecord& rec,
+               const Vec3& direction) const override {
+        return _albedo / (4 * Math::PI);
+    }
+
+    Real pdf(const Ray& ray, const HitRecord& rec,
+             const Vec3& direction) const override {
+        return 1 / (4 * Math::PI);
+    }
+
+    Color albedo(const HitRecord& rec) const override { return _albedo; }
+};
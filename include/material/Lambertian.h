@@ -1,19 +1,48 @@
+#pragma once
+
 #include "Material.h"
+#include "Texture.h"
 
 class Lambertian : public Material {
    private:
-    Color _albedo;
+    TexturePtr _albedo;
 
    public:
-    Lambertian(const Color& albedo) : _albedo(albedo) {}
+    Lambertian(const Color& albedo)
+        : _albedo(make_shared<SolidColor>(albedo)) {}
+    Lambertian(TexturePtr albedo) : _albedo(albedo) {}
+
+    // Renders must not be running while a material is edited.
+    void set_albedo(const Color& albedo) {
+        _albedo = make_shared<SolidColor>(albedo);
+    }
+    void set_albedo(TexturePtr albedo) { _albedo = albedo; }
 
     bool scatter(const Ray& ray, const HitRecord& rec, Color& attenuation,
                  Ray& scattered) const override {
         auto scatter_direction = rec.normal + Math::random_unit_vector();
         // Catch degenerate scatter direction
         if (scatter_direction.near_zero()) scatter_direction = rec.normal;
-        scattered = Ray(rec.point, scatter_direction);
-        attenuation = _albedo;
+        scattered = rec.spawn_ray(scatter_direction);
+        attenuation = _albedo->value(rec);
         return true;
     }
+
+    bool is_specular() const override { return false; }
+
+    Color eval(const Ray& ray, const HitRecord& rec,
+               const Vec3& direction) const override {
+        return _albedo->value(rec) * pdf(ray, rec, direction);
+    }
+
+    // scatter() is cosine weighted.
+    Real pdf(const Ray& ray, const HitRecord& rec,
+             const Vec3& direction) const override {
+        Real cosine = rec.normal.dot(direction.unit_vector());
+        return cosine > 0 ? cosine / Math::PI : 0;
+    }
+
+    Color albedo(const HitRecord& rec) const override {
+        return _albedo->value(rec);
+    }
 };
\ No newline at end of file
@@ -3,12 +3,14 @@
 #include "Color.h"
 #include "Geometry.h"
 
-Vec3d reflect(const Vec3d& v, const Vec3d& n) { return v - 2 * v.dot(n) * n; }
+inline Vec3 reflect(const Vec3& v, const Vec3& n) {
+    return v - 2 * v.dot(n) * n;
+}
 
-Vec3d refract(const Vec3d& uv, const Vec3d& n, double etai_over_etat) {
+inline Vec3 refract(const Vec3& uv, const Vec3& n, Real etai_over_etat) {
     auto cos_theta = fmin((-uv).dot(n), 1.0);
-    Vec3d r_out_perp = etai_over_etat * (uv + cos_theta * n);
-    Vec3d r_out_parallel = -sqrt(fabs(1.0 - r_out_perp.length_squared())) * n;
+    Vec3 r_out_perp = etai_over_etat * (uv + cos_theta * n);
+    Vec3 r_out_parallel = -sqrt(fabs(1.0 - r_out_perp.length_squared())) * n;
     return r_out_perp + r_out_parallel;
 }
 
@@ -17,4 +19,32 @@ class Material {
     virtual ~Material() = default;
     virtual bool scatter(const Ray& ray, const HitRecord& rec,
                          Color& attenuation, Ray& scattered) const = 0;
+
+    // Specular materials scatter into directions light sampling cannot hit,
+    // so only scatter() is used for them.
+    virtual bool is_specular() const { return true; }
+
+    // Phase functions of participating media, which scatter at points
+    // inside a volume rather than on a surface. Their hits have no normal.
+    virtual bool is_volume() const { return false; }
+
+    // BSDF times cosine for light leaving along -ray after arriving from
+    // direction.
+    virtual Color eval(const Ray& ray, const HitRecord& rec,
+                       const Vec3& direction) const {
+        return Color{0, 0, 0};
+    }
+
+    // Solid angle density with which scatter() picks direction.
+    virtual Real pdf(const Ray& ray, const HitRecord& rec,
+                     const Vec3& direction) const {
+        return 0;
+    }
+
+    // Surface color for previews.
+    virtual Color albedo(const HitRecord& rec) const { return Color{1, 1, 1}; }
+
+    // Radiance the surface emits towards the incoming ray.
+    virtual Color emitted(const HitRecord& rec) const { return Color{0, 0, 0}; }
+    virtual bool is_emissive() const { return false; }
 };
\ No newline at end of file
@@ -1,20 +1,37 @@
+#pragma once
+
 #include "Material.h"
+#include "Texture.h"
 
 class Metal : public Material {
    private:
-    Color _albedo;
-    double _fuzz;
+    TexturePtr _albedo;
+    Real _fuzz;
 
    public:
-    Metal(const Color& albedo, double fuzz)
+    Metal(const Color& albedo, Real fuzz)
+        : _albedo(make_shared<SolidColor>(albedo)),
+          _fuzz(fuzz < 1 ? fuzz : 1) {}
+    Metal(TexturePtr albedo, Real fuzz)
         : _albedo(albedo), _fuzz(fuzz < 1 ? fuzz : 1) {}
 
+    // Renders must not be running while a material is edited.
+    void set_albedo(const Color& albedo) {
+        _albedo = make_shared<SolidColor>(albedo);
+    }
+    void set_albedo(TexturePtr albedo) { _albedo = albedo; }
+    void set_fuzz(Real fuzz) { _fuzz = fuzz < 1 ? fuzz : 1; }
+
     bool scatter(const Ray& ray, const HitRecord& rec, Color& attenuation,
                  Ray& scattered) const override {
-        Vec3d reflected = reflect(ray.direction().unit_vector(), rec.normal);
-        scattered =
-            Ray(rec.point, reflected + _fuzz * Math::random_in_unit_sphere());
-        attenuation = _albedo;
+        Vec3 reflected = reflect(ray.direction().unit_vector(), rec.normal);
+        scattered = rec.spawn_ray(reflected +
+                                  _fuzz * Math::random_in_unit_sphere());
+        attenuation = _albedo->value(rec);
         return scattered.direction().dot(rec.normal) > 0;
     }
+
+    Color albedo(const HitRecord& rec) const override {
+        return _albedo->value(rec);
+    }
 };
\ No newline at end of file
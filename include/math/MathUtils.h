@@ -4,11 +4,18 @@
 #include <limits>
 #include <random>
 
-#include "Vector.h"
+// Scalar type of geometry, rays and shading. Configure with
+// RT_SINGLE_PRECISION for a float build, which halves the size of vectors
+// and hit records at some cost in accuracy.
+#ifdef RT_SINGLE_PRECISION
+using Real = float;
+#else
+using Real = double;
+#endif
 
 namespace Math {
 
-const double INF = std::numeric_limits<double>::infinity();
+const Real INF = std::numeric_limits<Real>::infinity();
 const double PI = 3.1415926535897932385;
 
 inline double deg_to_rad(double degrees) { return degrees * PI / 180.0; }
@@ -25,9 +32,14 @@ inline double random_double() {
 
 // Returns a random real in [min,max).
 inline double random_double(double min, double max) {
-    static std::uniform_real_distribution<double> distribution(min, max);
-    static std::mt19937 generator;
-    return distribution(generator);
+    return min + (max - min) * random_double();
+}
+
+// Bound on the relative rounding error of n chained floating point
+// operations in Real, as in Physically Based Rendering.
+inline constexpr Real gamma(int n) {
+    constexpr Real e = std::numeric_limits<Real>::epsilon() * 0.5;
+    return n * e / (1 - n * e);
 }
 
 // Clamp x to a range of [min, max]
@@ -39,4 +51,12 @@ inline double clamp(double x, double min, double max) {
     return x;
 }
 
+// Multiple importance sampling weight for a sample drawn with pdf_a when the
+// same direction could also have come from a strategy with pdf_b.
+inline double power_heuristic(double pdf_a, double pdf_b) {
+    double a2 = pdf_a * pdf_a;
+    double b2 = pdf_b * pdf_b;
+    return a2 + b2 > 0 ? a2 / (a2 + b2) : 0.0;
+}
+
 };  // namespace Math
\ No newline at end of file
@@ -1,8 +1,8 @@
 #pragma once
 #include <array>
 #include <functional>
-#include <initializer_list>
 #include <iostream>
+#include <type_traits>
 
 #include "MathUtils.h"
 
@@ -14,16 +14,17 @@ class Vec {
     // Fill length N vector with value of type T
     Vec(T value) { _data.fill(value); }
 
-    // Fill length N vector with a list
-    Vec(std::initializer_list<T> values) {
-        if (values.size() != N) {
-            throw std::runtime_error("Invalid initializer list size");
-        }
+    // Construct from N components of any arithmetic type, so literals and
+    // doubles work the same whatever T is.
+    template <typename... Args,
+              typename = std::enable_if_t<sizeof...(Args) == N &&
+                                          (std::is_arithmetic_v<Args> && ...)>>
+    Vec(Args... values) : _data{static_cast<T>(values)...} {}
 
-        size_t i = 0;
-        for (const auto& value : values) {
-            _data[i++] = value;
-        }
+    // Convert the components of a vector of another scalar type.
+    template <typename U>
+    explicit Vec(const Vec<U, N>& other) {
+        for (size_t i = 0; i < N; ++i) _data[i] = static_cast<T>(other[i]);
     }
 
     size_t size() const { return N; }
@@ -85,38 +86,29 @@ class Vec {
         return result;
     }
 
-    // Map each component of a vector to a new vector using func
-    template <typename U = T>
-    Vec<U, N> map(std::function<U(T)> func) const {
-        Vec<U, N> result;
-        for (size_t i = 0; i < N; i++) {
-            result[i] = func(_data[i]);
-        }
-        return result;
-    }
-
-    // Map each component of a vector to a new vector using func
-    template <typename U = T>
-    Vec<U, N> map(std::function<U(T, size_t)> func) const {
+    // Map each component of a vector to a new vector using func, which
+    // takes the component and optionally its index. func is a template
+    // parameter rather than a std::function so calls inline.
+    template <typename U = T, typename F>
+    Vec<U, N> map(F func) const {
         Vec<U, N> result;
         for (size_t i = 0; i < N; i++) {
-            result[i] = func(_data[i], i);
+            if constexpr (std::is_invocable_v<F, T, size_t>)
+                result[i] = func(_data[i], i);
+            else
+                result[i] = func(_data[i]);
         }
         return result;
     }
 
-    // Apply func to each component of a vector
-    Vec<T, N>& apply(std::function<void(T&)> func) {
-        for (T& value : _data) {
-            func(value);
-        }
-        return *this;
-    }
-
-    // Apply func to each component of a vector
-    Vec<T, N>& apply(std::function<void(T&, size_t)> func) {
+    // Apply func to each component of a vector, with its index optionally
+    template <typename F>
+    Vec<T, N>& apply(F func) {
         for (size_t i = 0; i < N; i++) {
-            func(_data[i], i);
+            if constexpr (std::is_invocable_v<F, T&, size_t>)
+                func(_data[i], i);
+            else
+                func(_data[i]);
         }
         return *this;
     }
@@ -125,40 +117,44 @@ class Vec {
 
     const T& operator[](size_t index) const { return _data[index]; }
 
+    // The operators below are plain loops rather than calls to map: GCC
+    // keeps map based versions out of line for Vec<float, 3>, whose 12
+    // bytes come back packed in registers and stall on the way through
+    // memory, which made the float build slower than the double one.
     Vec<T, N> operator-() const {
-        return map<T>([](T val) {
-            return -val;
-        });
+        Vec<T, N> result;
+        for (size_t i = 0; i < N; ++i) result._data[i] = -_data[i];
+        return result;
     }
 
     Vec<T, N> operator+(const Vec<T, N>& other) const {
-        return map<T>([&](T val, size_t i) {
-            return val + other[i];
-        });
+        Vec<T, N> result = *this;
+        for (size_t i = 0; i < N; ++i) result._data[i] += other._data[i];
+        return result;
     }
 
     Vec<T, N> operator-(const Vec<T, N>& other) const {
-        return map<T>([&](T val, size_t i) {
-            return val - other[i];
-        });
+        Vec<T, N> result = *this;
+        for (size_t i = 0; i < N; ++i) result._data[i] -= other._data[i];
+        return result;
     }
 
     Vec<T, N> operator*(const Vec<T, N>& other) const {
-        return map<T>([&](T val, size_t i) {
-            return val * other[i];
-        });
+        Vec<T, N> result = *this;
+        for (size_t i = 0; i < N; ++i) result._data[i] *= other._data[i];
+        return result;
     }
 
     Vec<T, N> operator*(const T& scalar) const {
-        return map<T>([&](T val) {
-            return val * scalar;
-        });
+        Vec<T, N> result = *this;
+        for (size_t i = 0; i < N; ++i) result._data[i] *= scalar;
+        return result;
     }
 
     Vec<T, N> operator/(const T& scalar) const {
-        return map<T>([&](T val) {
-            return val / scalar;
-        });
+        Vec<T, N> result = *this;
+        for (size_t i = 0; i < N; ++i) result._data[i] /= scalar;
+        return result;
     }
 
     Vec<T, N>& operator+=(const Vec<T, N>& other) {
@@ -217,28 +213,28 @@ class Vec {
     std::array<T, N> _data;
 };
 
-using Vec3d = Vec<double, 3>;
-using Point3d = Vec3d;
+using Vec3 = Vec<Real, 3>;
+using Point3 = Vec3;
 
 namespace Math {
-Vec3d random_in_unit_sphere() {
-    Vec3d p;
+inline Vec3 random_in_unit_sphere() {
+    Vec3 p;
     do {
-        p = Vec3d::random(-1, 1);
+        p = Vec3::random(-1, 1);
     } while (p.length_squared() >= 1);
     return p;
 }
 
-Vec3d random_in_unit_disk() {
-    Vec3d p;
+inline Vec3 random_in_unit_disk() {
+    Vec3 p;
     do {
-        p = Vec3d{Math::random_double(), Math::random_double(), 0};
+        p = Vec3{Math::random_double(-1, 1), Math::random_double(-1, 1), 0};
     } while (p.length_squared() >= 1);
     return p;
 }
 
-Vec3d random_in_hemisphere(const Vec3d& normal) {
-    Vec3d in_unit_sphere = random_in_unit_sphere();
+inline Vec3 random_in_hemisphere(const Vec3& normal) {
+    Vec3 in_unit_sphere = random_in_unit_sphere();
     // In the same hemisphere as the normal
     if (in_unit_sphere.dot(normal) > 0.0)
         return in_unit_sphere;
@@ -246,6 +242,12 @@ Vec3d random_in_hemisphere(const Vec3d& normal) {
         return -in_unit_sphere;
 }
 
-Vec3d random_unit_vector() { return random_in_unit_sphere().unit_vector(); }
+inline Vec3 random_unit_vector() {
+    return random_in_unit_sphere().unit_vector();
+}
+
+inline Vec3 abs(const Vec3& v) {
+    return Vec3{fabs(v[0]), fabs(v[1]), fabs(v[2])};
+}
 
 }  // namespace Math
\ No newline at end of file
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "Common.h"
+#include "Medium.h"
+
+// Coarse grid over a box holding, per cell, an upper bound of the
+// extinction anywhere in it. Delta tracking draws tentative collisions
+// against these local bounds instead of one bound for the whole medium,
+// so it takes few steps through thin parts and none through empty cells.
+class MajorantGrid {
+   private:
+    int _resolution;
+    vector<Real> _majorants;
+
+   public:
+    MajorantGrid(int resolution = 16)
+        : _resolution(resolution),
+          _majorants(resolution * resolution * resolution, 0) {}
+
+    int resolution() const { return _resolution; }
+
+    Real& at(int x, int y, int z) {
+        return _majorants[(z * _resolution + y) * _resolution + x];
+    }
+
+    Real at(int x, int y, int z) const {
+        return _majorants[(z * _resolution + y) * _resolution + x];
+    }
+};
+
+// Medium whose density is given on a regular grid of samples over a box,
+// interpolated trilinearly and zero outside the box. Collisions are found
+// by delta tracking: tentative ones are drawn against the majorant of each
+// cell of a MajorantGrid the ray passes, found by stepping through the
+// cells in order, and accepted with the ratio of the true extinction to
+// the majorant. The result is unbiased however loose the majorants are;
+// tight ones only make it faster.
+class GridMedium : public Medium {
+   private:
+    AABB _bounds;
+    int _nx, _ny, _nz;
+    vector<float> _density;
+    Real _sigma_t;
+    MajorantGrid _majorants;
+
+   public:
+    // density holds nx * ny * nz samples, x varying fastest, at the centers
+    // of the cells of a grid over bounds. Extinction is sigma_t times the
+    // interpolated density.
+    GridMedium(shared_ptr<Geometry> boundary, const AABB& bounds, int nx,
+               int ny, int nz, vector<float> density, Real sigma_t,
+               const Color& albedo, int majorant_resolution = 16)
+        : Medium(boundary, albedo),
+          _bounds(bounds),
+          _nx(nx),
+          _ny(ny),
+          _nz(nz),
+          _density(std::move(density)),
+          _sigma_t(sigma_t),
+          _majorants(majorant_resolution) {
+        if (nx <= 0 || ny <= 0 || nz <= 0 ||
+            _density.size() != static_cast<size_t>(nx) * ny * nz)
+            throw std::runtime_error("Density grid size mismatch");
+        build_majorants();
+    }
+
+    // Extinction at p.
+    Real sigma_t(const Point3& p) const {
+        Real g[3];
+        int n[3] = {_nx, _ny, _nz};
+        for (size_t a = 0; a < 3; ++a) {
+            g[a] = (p[a] - _bounds.min[a]) /
+                       (_bounds.max[a] - _bounds.min[a]) * n[a] -
+                   0.5;
+            if (g[a] < -0.5 || g[a] > n[a] - 0.5) return 0;
+        }
+        int i0[3], i1[3];
+        Real f[3];
+        for (size_t a = 0; a < 3; ++a) {
+            Real base = std::floor(g[a]);
+            f[a] = g[a] - base;
+            i0[a] = std::clamp(static_cast<int>(base), 0, n[a] - 1);
+            i1[a] = std::clamp(static_cast<int>(base) + 1, 0, n[a] - 1);
+        }
+        Real result = 0;
+        for (int corner = 0; corner < 8; ++corner) {
+            Real weight = 1;
+            int index[3];
+            for (size_t a = 0; a < 3; ++a) {
+                bool high = corner & (1 << a);
+                weight *= high ? f[a] : 1 - f[a];
+                index[a] = high ? i1[a] : i0[a];
+            }
+            result += weight * density(index[0], index[1], index[2]);
+        }
+        return _sigma_t * result;
+    }
+
+    const MajorantGrid& majorants() const { return _majorants; }
+
+   protected:
+    bool track(const Ray& ray, Real t_enter, Real t_exit,
+               Real& t) const override {
+        // Clip to the grid and step through the majorant cells the ray
+        // crosses, as in a 3D DDA.
+        int r = _majorants.resolution();
+        Point3 origin = ray.origin();
+        Vec3 d = ray.direction();
+        Real t0 = t_enter, t1 = t_exit;
+        Real cell_size[3];
+        for (size_t a = 0; a < 3; ++a) {
+            cell_size[a] = (_bounds.max[a] - _bounds.min[a]) / r;
+            Real inv = 1 / d[a];
+            Real near = (_bounds.min[a] - origin[a]) * inv;
+            Real far = (_bounds.max[a] - origin[a]) * inv;
+            if (inv < 0) std::swap(near, far);
+            t0 = std::max(t0, near);
+            t1 = std::min(t1, far);
+        }
+        if (!(t0 < t1)) return false;
+
+        int cell[3], step[3];
+        Real next[3], delta[3];
+        Point3 start = ray.at(t0);
+        for (size_t a = 0; a < 3; ++a) {
+            Real g = (start[a] - _bounds.min[a]) / cell_size[a];
+            cell[a] = std::clamp(static_cast<int>(g), 0, r - 1);
+            if (d[a] == 0) {
+                step[a] = 0;
+                next[a] = delta[a] = Math::INF;
+                continue;
+            }
+            step[a] = d[a] > 0 ? 1 : -1;
+            Real boundary =
+                _bounds.min[a] + (cell[a] + (d[a] > 0)) * cell_size[a];
+            next[a] = t0 + (boundary - start[a]) / d[a];
+            delta[a] = cell_size[a] / std::fabs(d[a]);
+        }
+
+        t = t0;
+        for (;;) {
+            int a = next[0] < next[1] ? (next[0] < next[2] ? 0 : 2)
+                                      : (next[1] < next[2] ? 1 : 2);
+            Real cell_exit = std::min(next[a], t1);
+            Real majorant = _majorants.at(cell[0], cell[1], cell[2]);
+            if (majorant > 0) {
+                for (;;) {
+                    t += free_path(ray, majorant);
+                    if (t >= cell_exit) break;
+                    // Real collision, or a null one that passes through.
+                    if (Math::random_double() * majorant <
+                        sigma_t(ray.at(t)))
+                        return true;
+                }
+            }
+            // Free paths are memoryless, so tracking restarts at the
+            // next cell.
+            t = cell_exit;
+            if (t >= t1) return false;
+            cell[a] += step[a];
+            if (cell[a] < 0 || cell[a] >= r) return false;
+            next[a] += delta[a];
+        }
+    }
+
+   private:
+    float density(int x, int y, int z) const {
+        return _density[(static_cast<size_t>(z) * _ny + y) * _nx + x];
+    }
+
+    // Largest sample that trilinear interpolation reads anywhere in each
+    // majorant cell.
+    void build_majorants() {
+        int r = _majorants.resolution();
+        int n[3] = {_nx, _ny, _nz};
+        for (int z = 0; z < r; ++z) {
+            for (int y = 0; y < r; ++y) {
+                for (int x = 0; x < r; ++x) {
+                    int cell[3] = {x, y, z};
+                    int lo[3], hi[3];
+                    for (size_t a = 0; a < 3; ++a) {
+                        Real scale = Real(n[a]) / r;
+                        lo[a] = std::max(
+                            int(std::floor(cell[a] * scale - 0.5)), 0);
+                        hi[a] = std::min(
+                            int(std::ceil((cell[a] + 1) * scale - 0.5)),
+                            n[a] - 1);
+                    }
+                    float m = 0;
+                    for (int k = lo[2]; k <= hi[2]; ++k)
+                        for (int j = lo[1]; j <= hi[1]; ++j)
+                            for (int i = lo[0]; i <= hi[0]; ++i)
+                                m = std::max(m, density(i, j, k));
+                    _majorants.at(x, y, z) = _sigma_t * m;
+                }
+            }
+        }
+    }
+};
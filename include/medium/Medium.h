@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cmath>
+
+#include "Geometry.h"
+#include "Isotropic.h"
+
+// A participating medium filling the inside of a closed, convex boundary
+// such as a sphere or a box of rectangles. hit() tracks the ray through the
+// medium and reports the first point where it scatters, with the phase
+// function as its material, so the integrator shades it like any other
+// hit. A ray that gets through finds whatever lies beyond; shadow rays are
+// blocked at random with the probability the light would be. Extinction is
+// the same in every color channel, the albedo of the phase function colors
+// the scattered light.
+class Medium : public Geometry {
+   protected:
+    shared_ptr<Geometry> _boundary;
+
+   public:
+    Medium(shared_ptr<Geometry> boundary, const Color& albedo)
+        : Geometry(make_shared<Isotropic>(albedo)), _boundary(boundary) {}
+
+    bool hit(const Ray& ray, Real t_min, Real t_max,
+             HitRecord& r_rec) const override {
+        Real t_enter, t_exit;
+        if (!inside(ray, t_min, t_max, t_enter, t_exit)) return false;
+        Real t;
+        if (!track(ray, t_enter, t_exit, t)) return false;
+
+        r_rec.t = t;
+        r_rec.point = ray.at(t);
+        r_rec.normal = Vec3(0);
+        r_rec.front_face = true;
+        r_rec.error = Vec3(0);
+        r_rec.material = _material.get();
+        r_rec.object = this;
+        r_rec.time = ray.time();
+        r_rec.u = r_rec.v = 0;
+        r_rec.uv_length = 1;
+        return true;
+    }
+
+    bool bounding_box(AABB& output_box) const override {
+        return _boundary->bounding_box(output_box);
+    }
+
+   protected:
+    // Sample the ray parameter of the first collision with the medium in
+    // (t_enter, t_exit). False if the ray gets through.
+    virtual bool track(const Ray& ray, Real t_enter, Real t_exit,
+                       Real& t) const = 0;
+
+    // Exponentially distributed free path, in units of the ray parameter,
+    // for extinction sigma_t per unit of distance.
+    static Real free_path(const Ray& ray, Real sigma_t) {
+        return -std::log(1 - Math::random_double()) /
+               (sigma_t * ray.direction().length());
+    }
+
+   private:
+    // Part of (t_min, t_max) the ray spends inside the boundary. Its origin
+    // may already be inside.
+    bool inside(const Ray& ray, Real t_min, Real t_max, Real& t_enter,
+                Real& t_exit) const {
+        HitRecord first, second;
+        if (!_boundary->hit(ray, -Math::INF, Math::INF, first)) return false;
+        if (!_boundary->hit(ray, first.t, Math::INF, second)) return false;
+        t_enter = std::max(first.t, t_min);
+        t_exit = std::min(second.t, t_max);
+        return t_enter < t_exit;
+    }
+};
+
+// Medium of constant density. Collisions follow the exponential
+// distribution directly, so tracking takes a single step.
+class HomogeneousMedium : public Medium {
+   private:
+    Real _sigma_t;
+
+   public:
+    // sigma_t is the extinction coefficient, collisions per unit of
+    // distance.
+    HomogeneousMedium(shared_ptr<Geometry> boundary, Real sigma_t,
+                      const Color& albedo)
+        : Medium(boundary, albedo), _sigma_t(sigma_t) {}
+
+   protected:
+    bool track(const Ray& ray, Real t_enter, Real t_exit,
+               Real& t) const override {
+        if (_sigma_t <= 0) return false;
+        t = t_enter + free_path(ray, _sigma_t);
+        return t < t_exit;
+    }
+};
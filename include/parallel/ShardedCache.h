@@ -0,0 +1,129 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "Common.h"
+
+// Values loaded on first use and evicted least recently used first once the
+// resident values exceed the memory budget. The cache is split into shards
+// with their own lock and an equal share of the budget, so threads rarely
+// wait on each other. A value in use by a thread stays alive until the
+// thread lets go of it even if it was evicted, so peak memory is the budget
+// plus at most one value per thread.
+//
+// The value just inserted is never evicted, so one larger than a shard's
+// share of the budget stays resident until another value of its shard
+// pushes it out instead of being read again on every use. The first such
+// value is reported on stderr, since the budget is then too small.
+template <typename T>
+class ShardedCache {
+   public:
+    using Ptr = shared_ptr<const T>;
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        size_t resident_bytes;
+        size_t peak_bytes;
+    };
+
+   private:
+    struct Entry {
+        uint64_t key;
+        Ptr value;
+        size_t bytes;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::list<Entry> lru;  // Most recent first
+        std::unordered_map<uint64_t, typename std::list<Entry>::iterator>
+            index;
+        size_t bytes = 0;
+    };
+
+    static constexpr size_t SHARDS = 16;
+
+    size_t _budget;
+    // What the values are, for the oversize warning.
+    std::string _what;
+    std::array<Shard, SHARDS> _shards;
+    std::atomic<uint64_t> _hits{0}, _misses{0}, _evictions{0};
+    std::atomic<size_t> _resident{0}, _peak{0};
+    std::atomic<bool> _warned{false};
+
+   public:
+    ShardedCache(size_t budget_bytes, std::string what)
+        : _budget(budget_bytes), _what(std::move(what)) {}
+
+    size_t budget() const { return _budget; }
+
+    // Largest value that fits its shard's share of the budget.
+    size_t shard_budget() const { return _budget / SHARDS; }
+
+    // Value of key, calling load() on a miss. load returns the value and
+    // its resident size in bytes.
+    template <typename Load>
+    Ptr fetch(uint64_t key, Load&& load) {
+        Shard& shard = _shards[(key * 0x9E3779B97F4A7C15ull) >> 60];
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.index.find(key);
+            if (it != shard.index.end()) {
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+                ++_hits;
+                return it->second->value;
+            }
+        }
+
+        // Load outside the lock; a racing thread may load the same value, in
+        // which case the first copy inserted wins.
+        ++_misses;
+        std::pair<Ptr, size_t> loaded = load();
+        if (loaded.second > shard_budget() && !_warned.exchange(true)) {
+            std::cerr << "Warning: a " << _what << " of " << loaded.second
+                      << " bytes exceeds the cache's share of "
+                      << shard_budget() << " bytes per shard; raise the "
+                      << "budget to at least " << loaded.second * SHARDS
+                      << " bytes to keep it resident" << std::endl;
+        }
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) return it->second->value;
+
+        shard.lru.push_front(Entry{key, loaded.first, loaded.second});
+        shard.index[key] = shard.lru.begin();
+        shard.bytes += loaded.second;
+        _resident += loaded.second;
+
+        while (shard.bytes > shard_budget() && shard.lru.size() > 1) {
+            const Entry& victim = shard.lru.back();
+            shard.bytes -= victim.bytes;
+            _resident -= victim.bytes;
+            shard.index.erase(victim.key);
+            shard.lru.pop_back();
+            ++_evictions;
+        }
+
+        size_t resident = _resident;
+        size_t peak = _peak;
+        while (resident > peak &&
+               !_peak.compare_exchange_weak(peak, resident)) {
+        }
+        return loaded.first;
+    }
+
+    Stats stats() const {
+        return {_hits, _misses, _evictions, _resident, _peak};
+    }
+};
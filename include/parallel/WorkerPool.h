@@ -0,0 +1,205 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "Common.h"
+
+// Threads started once and reused for every parallel loop, so short loops
+// do not pay for starting threads. Several loops can be under way at once:
+// whenever a thread finishes an index it takes the next index of the most
+// urgent loop, with higher priority first and loops started earlier first
+// among equals. A loop started with a higher priority thus gets every
+// thread within one index of each, and the loops it preempts continue once
+// it is done.
+class WorkerPool {
+   public:
+    // Loop started with post(), to cancel it with.
+    class Loop {
+       private:
+        friend class WorkerPool;
+
+        std::function<void(size_t)> task;
+        std::function<void(std::exception_ptr)> done;
+        size_t count = 0;
+        size_t next = 0;
+        // Calls running.
+        size_t busy = 0;
+        int priority = 0;
+        bool cancelled = false;
+        bool finished = false;
+        std::exception_ptr error;
+
+        bool exhausted() const { return cancelled || next == count; }
+    };
+
+   private:
+    unsigned int _size;
+    vector<std::thread> _threads;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    // A loop finished.
+    std::condition_variable _done;
+    // Loops with indices left or calls running, by decreasing priority and
+    // in the order they started among equals.
+    vector<shared_ptr<Loop>> _loops;
+    bool _stop = false;
+
+   public:
+    // threads in total including the caller of parallel_for, 0 for one per
+    // hardware thread. Loops started with post() have no caller working on
+    // them, so even a pool of one starts a thread of its own for those.
+    // Each thread of the pool calls on_start once when it starts, e.g. to
+    // name itself.
+    explicit WorkerPool(unsigned int threads = 0,
+                        std::function<void()> on_start = nullptr) {
+        if (threads == 0)
+            threads = std::max(std::thread::hardware_concurrency(), 1u);
+        _size = threads;
+        for (unsigned int i = 1; i < std::max(threads, 2u); ++i) {
+            _threads.emplace_back([this, on_start]() {
+                if (on_start) on_start();
+                work();
+            });
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Threads finish the calls they are in. Loops not done by then are
+    // dropped without calling their done.
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _wake.notify_all();
+        for (auto& thread : _threads) thread.join();
+    }
+
+    // Threads working on a loop, the caller of parallel_for included.
+    size_t size() const { return _size; }
+
+    // Call task(i) for every i in [0, count) and return once all calls
+    // finished. Indices are handed out one at a time, so each call should
+    // do a fair amount of work. The caller works on this loop only, while
+    // the pool's threads may be busy with more urgent ones. The first
+    // exception a call throws is rethrown here after the others finished.
+    void parallel_for(size_t count, const std::function<void(size_t)>& task,
+                      int priority = 0) {
+        if (count == 0) return;
+        auto loop = make_shared<Loop>();
+        loop->task = [&task](size_t i) { task(i); };
+        loop->count = count;
+        loop->priority = priority;
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        // A pool of one is the caller alone.
+        if (_size > 1) {
+            insert(loop);
+            _wake.notify_all();
+        }
+        while (!loop->exhausted()) run(loop, lock);
+        _done.wait(lock, [&]() { return loop->finished; });
+        if (loop->error) std::rethrow_exception(loop->error);
+    }
+
+    // Start calling task(i) for every i in [0, count) on the pool's threads
+    // and return at once. done(error) is called on the thread that ends
+    // the loop once all calls finished, with the first exception a call
+    // threw or null.
+    shared_ptr<Loop> post(size_t count, std::function<void(size_t)> task,
+                          int priority = 0,
+                          std::function<void(std::exception_ptr)> done =
+                              nullptr) {
+        auto loop = make_shared<Loop>();
+        loop->task = std::move(task);
+        loop->done = std::move(done);
+        loop->count = count;
+        loop->priority = priority;
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (count == 0) {
+            finish(loop, lock);
+            return loop;
+        }
+        insert(loop);
+        _wake.notify_all();
+        return loop;
+    }
+
+    // Hand out no more indices of loop. Its done is called once the calls
+    // running now finished, right here if none are.
+    void cancel(const shared_ptr<Loop>& loop) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (loop->finished || loop->cancelled) return;
+        loop->cancelled = true;
+        if (loop->busy == 0) finish(loop, lock);
+    }
+
+   private:
+    void insert(const shared_ptr<Loop>& loop) {
+        auto position = std::find_if(
+            _loops.begin(), _loops.end(), [&](const auto& other) {
+                return other->priority < loop->priority;
+            });
+        _loops.insert(position, loop);
+    }
+
+    void work() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        for (;;) {
+            shared_ptr<Loop> loop;
+            _wake.wait(lock, [&]() {
+                if (_stop) return true;
+                for (const auto& candidate : _loops) {
+                    if (candidate->exhausted()) continue;
+                    loop = candidate;
+                    return true;
+                }
+                return false;
+            });
+            if (_stop) return;
+            run(loop, lock);
+        }
+    }
+
+    // Make the next call of loop, with lock held before and after.
+    void run(const shared_ptr<Loop>& loop, std::unique_lock<std::mutex>& lock) {
+        size_t i = loop->next++;
+        ++loop->busy;
+        lock.unlock();
+        std::exception_ptr error;
+        try {
+            loop->task(i);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+        if (error && !loop->error) loop->error = error;
+        --loop->busy;
+        if (loop->exhausted() && loop->busy == 0) finish(loop, lock);
+    }
+
+    // Retire loop and call its done without the lock.
+    void finish(const shared_ptr<Loop>& loop,
+                std::unique_lock<std::mutex>& lock) {
+        _loops.erase(std::remove(_loops.begin(), _loops.end(), loop),
+                     _loops.end());
+        loop->finished = true;
+        loop->task = nullptr;
+        auto done = std::move(loop->done);
+        loop->done = nullptr;
+        _done.notify_all();
+        if (done) {
+            lock.unlock();
+            done(loop->error);
+            lock.lock();
+        }
+    }
+};
@@ -0,0 +1,235 @@
+#pragma once
+
+#include "AABB.h"
+#include "Color.h"
+#include "Common.h"
+#include "Geometry.h"
+#include "Material.h"
+#include "MathUtils.h"
+#include "PhotonMap.h"
+#include "Scene.h"
+#include "WorkerPool.h"
+
+// Shoots photons from the emitters and the background of a scene and keeps
+// those that reach a diffuse surface through one or more specular bounces,
+// the light paths behind caustics. Photons from the background are aimed at
+// the bounding spheres of the specular objects, since nothing else can turn
+// them into a caustic.
+class CausticTracer {
+   private:
+    struct Target {
+        Point3 center;
+        double radius;
+        double probability;
+    };
+
+    static constexpr int MAX_BOUNCES = 16;
+
+    const Scene& _scene;
+    vector<Target> _targets;
+    vector<double> _emitter_cdf;
+    Point3 _center;
+    double _radius;
+    double _sky_probability = 0;  // Chance a photon starts at the background
+
+   public:
+    CausticTracer(const Scene& scene) : _scene(scene) {
+        AABB bounds = scene.bvh.primitive_bounds();
+        _center = bounds.empty() ? Point3(0) : bounds.center();
+        _radius =
+            bounds.empty() ? 0 : 0.5 * (bounds.max - bounds.min).length();
+
+        double target_area = 0;
+        for (const auto& object : scene.objects.objects()) {
+            AABB box;
+            const auto& material = object->material();
+            if (!material || !material->is_specular() ||
+                material->is_emissive() || !object->bounding_box(box))
+                continue;
+            double radius = 0.5 * (box.max - box.min).length();
+            _targets.push_back({box.center(), radius, radius * radius});
+            target_area += Math::PI * radius * radius;
+        }
+        for (auto& target : _targets) {
+            target.probability *= Math::PI / target_area;
+        }
+
+        double emitter_power = 0;
+        for (const auto& emitter : scene.emitters) {
+            emitter_power += Math::PI * emitter->area() * emission(*emitter);
+            _emitter_cdf.push_back(emitter_power);
+        }
+        for (auto& c : _emitter_cdf) c /= emitter_power;
+
+        // Power the background sends through the target spheres, counting
+        // overlaps twice, which is good enough to split the photons.
+        double sky_power = 0;
+        if (!_targets.empty()) {
+            const int SAMPLES = 256;
+            for (int i = 0; i < SAMPLES; ++i) {
+                sky_power += luminance(_scene.background->radiance(
+                    Math::random_unit_vector()));
+            }
+            sky_power *= 4 * Math::PI / SAMPLES * target_area;
+        }
+        if (sky_power + emitter_power > 0)
+            _sky_probability = sky_power / (sky_power + emitter_power);
+    }
+
+    // Shoot count photons and build a map of the stored ones, on pool at
+    // priority or on the calling thread alone without a pool. Their powers
+    // are scaled so the map estimates radiance directly.
+    PhotonMap shoot(int count, WorkerPool* pool = nullptr,
+                    int priority = 0) const {
+        size_t chunks = pool ? pool->size() : 1;
+        vector<vector<Photon>> stored(chunks);
+        if (_sky_probability > 0 || !_emitter_cdf.empty()) {
+            auto shoot_chunk = [&](size_t c) {
+                long begin = static_cast<long>(count) * c / chunks;
+                long end = static_cast<long>(count) * (c + 1) / chunks;
+                for (long i = begin; i < end; ++i) emit(count, stored[c]);
+            };
+            if (pool)
+                pool->parallel_for(chunks, shoot_chunk, priority);
+            else
+                shoot_chunk(0);
+        }
+
+        vector<Photon> photons;
+        for (const auto& s : stored) {
+            photons.insert(photons.end(), s.begin(), s.end());
+        }
+        return PhotonMap(std::move(photons), pool, priority);
+    }
+
+   private:
+    static double emission(const Geometry& object) {
+        HitRecord rec;
+        rec.front_face = true;
+        return luminance(object.material()->emitted(rec));
+    }
+
+    void emit(int count, vector<Photon>& stored) const {
+        if (Math::random_double() < _sky_probability) {
+            emit_from_background(count * _sky_probability, stored);
+        } else if (!_emitter_cdf.empty()) {
+            emit_from_emitter(count * (1 - _sky_probability), stored);
+        }
+    }
+
+    void emit_from_emitter(double count, vector<Photon>& stored) const {
+        double u = Math::random_double();
+        size_t index = std::lower_bound(_emitter_cdf.begin(),
+                                        _emitter_cdf.end(), u) -
+                       _emitter_cdf.begin();
+        index = std::min(index, _emitter_cdf.size() - 1);
+        double probability =
+            _emitter_cdf[index] - (index > 0 ? _emitter_cdf[index - 1] : 0);
+        const Geometry& emitter = *_scene.emitters[index];
+
+        // Photons leave at times spread over the shutter like camera rays.
+        HitRecord rec;
+        rec.front_face = true;
+        rec.time = _scene.camera.sample_time();
+        rec.point = emitter.sample_point(rec.normal, rec.time);
+        // Sampled points carry no error bound; allow a few ulps of their
+        // coordinates, as for hits.
+        rec.error = Math::gamma(8) * Math::abs(rec.point);
+        Color emitted = emitter.material()->emitted(rec);
+        Vec3 direction = rec.normal + Math::random_unit_vector();
+        if (direction.length_squared() < 1e-12) return;
+
+        // Cosine weighted directions from a uniform point leave
+        // pi * area * Le per unit of density.
+        Color power =
+            emitted * (Math::PI * emitter.area() / (probability * count));
+        trace(rec.spawn_ray(direction), power, stored);
+    }
+
+    void emit_from_background(double count, vector<Photon>& stored) const {
+        const Background& background = *_scene.background;
+        Vec3 direction;
+        Real direction_pdf;
+        Color radiance;
+        if (background.can_sample()) {
+            radiance = background.sample(direction, direction_pdf);
+            if (!(direction_pdf > 0)) return;
+        } else {
+            direction = Math::random_unit_vector();
+            direction_pdf = 1 / (4 * Math::PI);
+            radiance = background.radiance(direction);
+        }
+
+        // Uniform point on the disk of a target facing direction.
+        double u = Math::random_double();
+        size_t index = 0;
+        while (index + 1 < _targets.size() &&
+               u >= _targets[index].probability) {
+            u -= _targets[index].probability;
+            ++index;
+        }
+        const Target& target = _targets[index];
+        Vec3 w = direction.unit_vector();
+        Vec3 a = std::fabs(w.x()) > 0.9 ? Vec3{0, 1, 0} : Vec3{1, 0, 0};
+        Vec3 s = w.cross(a).unit_vector();
+        Vec3 t = w.cross(s);
+        Vec3 disk = Math::random_in_unit_disk();
+        Point3 point = target.center +
+                        target.radius * (disk.x() * s + disk.y() * t);
+
+        // Photons cross area perpendicular to w with the density of every
+        // target disk they pass through.
+        double density = 0;
+        for (const auto& other : _targets) {
+            Vec3 offset = point - other.center;
+            double along = offset.dot(w);
+            if (offset.length_squared() - along * along <=
+                other.radius * other.radius)
+                density += other.probability /
+                           (Math::PI * other.radius * other.radius);
+        }
+        if (!(density > 0)) return;
+
+        double distance = 2 * (_radius + (point - _center).length());
+        Color power = radiance / (direction_pdf * density * count);
+        trace(Ray(point + distance * w, -w, _scene.camera.sample_time()),
+              power, stored);
+    }
+
+    // Follow a photon through specular bounces and store it at the diffuse
+    // surface it reaches after at least one. Photons scattering in a medium
+    // are dropped.
+    void trace(Ray ray, Color power, vector<Photon>& stored) const {
+        bool caustic = false;
+        for (int bounce = 0; bounce < MAX_BOUNCES; ++bounce) {
+            HitRecord rec;
+            if (!_scene.bvh.hit(ray, 0, Math::INF, rec)) return;
+            const Material& material = *rec.material;
+            if (!material.is_specular()) {
+                if (caustic && !material.is_emissive() &&
+                    !material.is_volume()) {
+                    Vec3 d = ray.direction().unit_vector();
+                    stored.push_back(
+                        {{static_cast<float>(rec.point.x()),
+                          static_cast<float>(rec.point.y()),
+                          static_cast<float>(rec.point.z())},
+                         {static_cast<float>(power.x()),
+                          static_cast<float>(power.y()),
+                          static_cast<float>(power.z())},
+                         {static_cast<float>(d.x()), static_cast<float>(d.y()),
+                          static_cast<float>(d.z())},
+                         0});
+                }
+                return;
+            }
+
+            Color attenuation;
+            Ray scattered;
+            if (!material.scatter(ray, rec, attenuation, scattered)) return;
+            power *= attenuation;
+            if (luminance(power) <= 0) return;
+            caustic = true;
+            ray = scattered;
+        }
+    }
+};
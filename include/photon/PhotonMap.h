@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#include "Color.h"
+#include "Common.h"
+#include "Vector.h"
+#include "WorkerPool.h"
+
+struct Photon {
+    float position[3];
+    float power[3];
+    float direction[3];  // Direction of travel when the photon arrived
+    uint8_t axis;        // Split axis of the kd-tree node
+
+    Point3 point() const { return {position[0], position[1], position[2]}; }
+    Color flux() const { return {power[0], power[1], power[2]}; }
+    Vec3 incoming() const { return {direction[0], direction[1], direction[2]}; }
+};
+
+// Balanced kd-tree over photons stored implicitly in one array: the node
+// for range [begin, end) is the median photon at (begin + end) / 2, with
+// its subtrees to the left and right. Lookups walk contiguous memory and
+// need no pointers. Given a WorkerPool, the top levels are partitioned on
+// its threads.
+class PhotonMap {
+   private:
+    vector<Photon> _photons;
+
+   public:
+    PhotonMap() {}
+    PhotonMap(vector<Photon> photons, WorkerPool* pool = nullptr,
+              int priority = 0)
+        : _photons(std::move(photons)) {
+        int parallel_depth = 0;
+        while (pool && (size_t(1) << parallel_depth) < pool->size())
+            ++parallel_depth;
+        build(0, _photons.size(), pool, priority, parallel_depth);
+    }
+
+    size_t size() const { return _photons.size(); }
+
+    // Call visit(photon, squared distance) for every photon within radius
+    // of point.
+    template <typename F>
+    void lookup(const Point3& point, double radius, F&& visit) const {
+        if (_photons.empty()) return;
+        double radius2 = radius * radius;
+        std::pair<size_t, size_t> stack[64];
+        int stack_size = 0;
+        stack[stack_size++] = {0, _photons.size()};
+        while (stack_size > 0) {
+            auto [begin, end] = stack[--stack_size];
+            if (begin >= end) continue;
+            size_t mid = (begin + end) / 2;
+            const Photon& photon = _photons[mid];
+
+            double distance2 = 0;
+            for (int a = 0; a < 3; ++a) {
+                double d = point[a] - photon.position[a];
+                distance2 += d * d;
+            }
+            if (distance2 <= radius2) visit(photon, distance2);
+
+            double d = point[photon.axis] - photon.position[photon.axis];
+            std::pair<size_t, size_t> near{begin, mid}, far{mid + 1, end};
+            if (d > 0) std::swap(near, far);
+            if (d * d <= radius2) stack[stack_size++] = far;
+            stack[stack_size++] = near;
+        }
+    }
+
+   private:
+    void build(size_t begin, size_t end, WorkerPool* pool, int priority,
+               int parallel_depth) {
+        if (end - begin <= 1) {
+            if (begin < end) _photons[begin].axis = 0;
+            return;
+        }
+
+        float lo[3] = {INFINITY, INFINITY, INFINITY};
+        float hi[3] = {-INFINITY, -INFINITY, -INFINITY};
+        for (size_t i = begin; i < end; ++i) {
+            for (int a = 0; a < 3; ++a) {
+                lo[a] = std::min(lo[a], _photons[i].position[a]);
+                hi[a] = std::max(hi[a], _photons[i].position[a]);
+            }
+        }
+        uint8_t axis = 0;
+        for (uint8_t a = 1; a < 3; ++a) {
+            if (hi[a] - lo[a] > hi[axis] - lo[axis]) axis = a;
+        }
+
+        size_t mid = (begin + end) / 2;
+        std::nth_element(_photons.begin() + begin, _photons.begin() + mid,
+                         _photons.begin() + end,
+                         [axis](const Photon& a, const Photon& b) {
+                             return a.position[axis] < b.position[axis];
+                         });
+        _photons[mid].axis = axis;
+
+        if (parallel_depth > 0) {
+            pool->parallel_for(
+                2,
+                [&](size_t side) {
+                    if (side == 0)
+                        build(begin, mid, pool, priority, parallel_depth - 1);
+                    else
+                        build(mid + 1, end, pool, priority,
+                              parallel_depth - 1);
+                },
+                priority);
+        } else {
+            build(begin, mid, nullptr, 0, 0);
+            build(mid + 1, end, nullptr, 0, 0);
+        }
+    }
+};
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+
+#include "BVH.h"
+#include "Common.h"
+#include "WorkerPool.h"
+
+// Rays stored component by component, for queries on many rays at once.
+// Rays are traced over (t_min, t_max) of their own parameter, so with
+// direction set to the vector between two points, t_max 1 tests the
+// segment between them.
+struct RayBatch {
+    vector<Real> origin_x, origin_y, origin_z;
+    vector<Real> direction_x, direction_y, direction_z;
+    vector<Real> t_min, t_max;
+    // Moment within the shutter interval, for scenes with moving objects.
+    vector<Real> time;
+
+    size_t size() const { return origin_x.size(); }
+
+    void reserve(size_t n) {
+        for (auto* v : components()) v->reserve(n);
+    }
+
+    void clear() {
+        for (auto* v : components()) v->clear();
+    }
+
+    void add(const Point3& origin, const Vec3& direction,
+             Real t_end = Math::INF, Real t_start = 0, Real ray_time = 0) {
+        origin_x.push_back(origin[0]);
+        origin_y.push_back(origin[1]);
+        origin_z.push_back(origin[2]);
+        direction_x.push_back(direction[0]);
+        direction_y.push_back(direction[1]);
+        direction_z.push_back(direction[2]);
+        t_min.push_back(t_start);
+        t_max.push_back(t_end);
+        time.push_back(ray_time);
+    }
+
+    Ray ray(size_t i) const {
+        return Ray(Point3{origin_x[i], origin_y[i], origin_z[i]},
+                   Vec3{direction_x[i], direction_y[i], direction_z[i]},
+                   time[i]);
+    }
+
+    // Throws unless every component holds the same number of rays.
+    void check() const {
+        for (const auto* v : components()) {
+            if (v->size() != size())
+                throw std::invalid_argument("Ray batch components differ "
+                                            "in length");
+        }
+    }
+
+   private:
+    std::array<vector<Real>*, 9> components() {
+        return {&origin_x,    &origin_y,    &origin_z, &direction_x,
+                &direction_y, &direction_z, &t_min,    &t_max,
+                &time};
+    }
+
+    std::array<const vector<Real>*, 9> components() const {
+        return {&origin_x,    &origin_y,    &origin_z, &direction_x,
+                &direction_y, &direction_z, &t_min,    &t_max,
+                &time};
+    }
+};
+
+// Closest hits of the rays of a batch that hit anything, in the order of
+// the rays, stored component by component.
+struct HitBatch {
+    // Index of the ray in its batch.
+    vector<uint32_t> ray;
+    vector<Real> t;
+    // Index of the object hit among those the query was built from.
+    vector<int> primitive;
+    // Surface coordinates of the hit.
+    vector<Real> u, v;
+    // Unit surface normal, facing against the ray.
+    vector<Real> normal_x, normal_y, normal_z;
+
+    size_t size() const { return ray.size(); }
+
+    void clear() {
+        ray.clear();
+        t.clear();
+        primitive.clear();
+        u.clear();
+        v.clear();
+        normal_x.clear();
+        normal_y.clear();
+        normal_z.clear();
+    }
+
+    void add(uint32_t index, const HitRecord& rec) {
+        ray.push_back(index);
+        t.push_back(rec.t);
+        primitive.push_back(rec.primitive);
+        u.push_back(rec.u);
+        v.push_back(rec.v);
+        normal_x.push_back(rec.normal[0]);
+        normal_y.push_back(rec.normal[1]);
+        normal_z.push_back(rec.normal[2]);
+    }
+
+    void append(const HitBatch& other) {
+        ray.insert(ray.end(), other.ray.begin(), other.ray.end());
+        t.insert(t.end(), other.t.begin(), other.t.end());
+        primitive.insert(primitive.end(), other.primitive.begin(),
+                         other.primitive.end());
+        u.insert(u.end(), other.u.begin(), other.u.end());
+        v.insert(v.end(), other.v.begin(), other.v.end());
+        normal_x.insert(normal_x.end(), other.normal_x.begin(),
+                        other.normal_x.end());
+        normal_y.insert(normal_y.end(), other.normal_y.begin(),
+                        other.normal_y.end());
+        normal_z.insert(normal_z.end(), other.normal_z.begin(),
+                        other.normal_z.end());
+    }
+};
+
+// Intersection queries on batches of rays against a set of objects, for
+// programs that need visibility or line of sight but no images. Batches
+// are split into chunks that the threads of a WorkerPool trace in
+// parallel. Within a chunk, runs of BVH::LANES consecutive rays that start
+// close together and point the same way are traced as one bundle, so
+// batches with neighbouring rays next to each other, such as sensor
+// sweeps, run faster; other rays are traced one by one. Objects are
+// identified by their index in the vector the query was built from.
+class RayQuery {
+   private:
+    BVH _bvh;
+    shared_ptr<WorkerPool> _pool;
+    // Distance within which the origins of a bundle must lie.
+    Real _spread;
+
+   public:
+    // Rays per chunk handed to a thread.
+    static constexpr size_t CHUNK_SIZE = 1024;
+
+    RayQuery(const vector<shared_ptr<Geometry>>& objects,
+             shared_ptr<WorkerPool> pool = nullptr,
+             int leaf_size = BVH::DEFAULT_LEAF_SIZE)
+        : _bvh(objects, leaf_size),
+          _pool(pool ? pool : make_shared<WorkerPool>()) {
+        AABB bounds = _bvh.primitive_bounds();
+        _spread =
+            bounds.empty() ? 0 : 0.01 * (bounds.max - bounds.min).length();
+    }
+
+    const BVH& bvh() const { return _bvh; }
+
+    // Closest hit of every ray, replacing the contents of hits.
+    void closest_hit(const RayBatch& rays, HitBatch& hits) const {
+        rays.check();
+        vector<HitBatch> chunks(chunk_count(rays));
+        _pool->parallel_for(chunks.size(), [&](size_t chunk) {
+            HitBatch& out = chunks[chunk];
+            for_lanes(rays, chunk, [&](size_t first, BVH::Lanes& lanes) {
+                HitRecord records[BVH::LANES];
+                uint8_t hit[BVH::LANES];
+                if (lanes.coherent(_spread)) {
+                    _bvh.hit_lanes(lanes, records, hit);
+                } else {
+                    for (int l = 0; l < lanes.count; ++l) {
+                        hit[l] = _bvh.hit(*lanes.rays[l], lanes.t_min[l],
+                                          lanes.t_max[l], records[l]);
+                    }
+                }
+                for (int l = 0; l < lanes.count; ++l) {
+                    if (hit[l])
+                        out.add(static_cast<uint32_t>(first + l), records[l]);
+                }
+            });
+        });
+
+        hits.clear();
+        for (const auto& chunk : chunks) hits.append(chunk);
+    }
+
+    // Whether each ray hits anything, 1 or 0 per ray. Traversal stops at
+    // the first hit found, so this is cheaper than closest_hit.
+    void any_hit(const RayBatch& rays, vector<uint8_t>& occluded) const {
+        rays.check();
+        occluded.resize(rays.size());
+        _pool->parallel_for(chunk_count(rays), [&](size_t chunk) {
+            for_lanes(rays, chunk, [&](size_t first, BVH::Lanes& lanes) {
+                if (lanes.coherent(_spread)) {
+                    _bvh.occluded_lanes(lanes, &occluded[first]);
+                    return;
+                }
+                for (int l = 0; l < lanes.count; ++l) {
+                    occluded[first + l] = _bvh.occluded(
+                        *lanes.rays[l], lanes.t_min[l], lanes.t_max[l]);
+                }
+            });
+        });
+    }
+
+   private:
+    static size_t chunk_count(const RayBatch& rays) {
+        return (rays.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    }
+
+    // Call trace(first, lanes) for the rays of chunk, BVH::LANES at a time
+    // starting with ray first.
+    template <typename Trace>
+    static void for_lanes(const RayBatch& rays, size_t chunk,
+                          const Trace& trace) {
+        size_t end = std::min(rays.size(), (chunk + 1) * CHUNK_SIZE);
+        Ray bundle[BVH::LANES];
+        for (size_t first = chunk * CHUNK_SIZE; first < end;
+             first += BVH::LANES) {
+            BVH::Lanes lanes;
+            size_t count = std::min<size_t>(BVH::LANES, end - first);
+            for (size_t l = 0; l < count; ++l) {
+                bundle[l] = rays.ray(first + l);
+                lanes.add(bundle[l], rays.t_min[first + l],
+                          rays.t_max[first + l]);
+            }
+            trace(first, lanes);
+        }
+    }
+};
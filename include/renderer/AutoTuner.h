@@ -0,0 +1,262 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include "Renderer.h"
+#include "Scene.h"
+
+// The machine the renderer runs on.
+namespace Host {
+
+inline std::string name() {
+#if defined(__unix__) || defined(__APPLE__)
+    char buffer[256] = {};
+    if (gethostname(buffer, sizeof(buffer) - 1) == 0 && buffer[0])
+        return buffer;
+#endif
+    return "localhost";
+}
+
+// Hardware threads this process may run on, which under taskset or a
+// cpuset can be fewer, and numbered differently, than those of the machine.
+inline vector<int> cpus() {
+    vector<int> result;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            if (CPU_ISSET(cpu, &set)) result.push_back(cpu);
+    }
+#endif
+    if (result.empty()) {
+        unsigned int count = std::max(std::thread::hardware_concurrency(), 1u);
+        for (unsigned int cpu = 0; cpu < count; ++cpu) result.push_back(cpu);
+    }
+    return result;
+}
+
+inline unsigned int hardware_threads() {
+    return static_cast<unsigned int>(cpus().size());
+}
+
+// Cores among cpus(), counting the SMT siblings of each only once. Read from
+// the Linux CPU topology; elsewhere every hardware thread counts as a core.
+inline unsigned int physical_cores() {
+    std::set<std::pair<int, int>> cores;
+    for (int cpu : cpus()) {
+        std::string topology = "/sys/devices/system/cpu/cpu" +
+                               std::to_string(cpu) + "/topology/";
+        std::ifstream package(topology + "physical_package_id");
+        std::ifstream core(topology + "core_id");
+        int package_id, core_id;
+        if (!(package >> package_id) || !(core >> core_id))
+            return hardware_threads();
+        cores.insert({package_id, core_id});
+    }
+    return std::max(static_cast<unsigned int>(cores.size()), 1u);
+}
+
+}  // namespace Host
+
+// Render settings picked by AutoTuner, and the calibration throughput they
+// reached.
+struct TunedSettings {
+    unsigned int threads = 0;
+    int tile_size = 32;
+    int leaf_size = BVH::DEFAULT_LEAF_SIZE;
+    double rays_per_second = 0;
+
+    // Use the settings for rendering scene with option.
+    void apply(Scene& scene, RenderOption& option) const {
+        option.threads = threads;
+        option.tile_size = tile_size;
+        if (scene.bvh.leaf_size() != leaf_size) scene.rebuild_bvh(leaf_size);
+    }
+};
+
+// Picks the thread count, tile size and BVH leaf size that render a scene
+// fastest on this host. Each candidate renders the scene at low resolution
+// and few samples per pixel with CPU_MT_Renderer, and the one tracing the
+// most rays per second wins. The parameters are tuned one after another,
+// each with the best values found so far for the others: threads first,
+// one per core (as with SMT off) and one per hardware thread, then leaf
+// size, then tile size. Results are kept per scene in a cache file named
+// after the host, so later runs on the same machine skip calibration.
+class AutoTuner {
+   public:
+    int width = 160;
+    int height = 90;
+    int samples_per_pixel = 4;
+    vector<int> tile_sizes = {8, 16, 32, 64};
+    vector<int> leaf_sizes = {1, 2, 4, 8, 16};
+
+   private:
+    std::string _cache_file;
+
+   public:
+    AutoTuner(std::string cache_file = default_cache_file())
+        : _cache_file(std::move(cache_file)) {}
+
+    static std::string default_cache_file() {
+        return "autotune-" + Host::name() + ".cache";
+    }
+
+    // Cache key of a workload: the scene, the integrator, and the path,
+    // size and modification time of each file the scene reads (geometry,
+    // environment map), so a changed file is tuned again. Empty file names
+    // stand for a file not used. Whitespace becomes '_' to keep the key one
+    // word of the cache file.
+    static std::string workload_key(const std::string& scene,
+                                    const std::string& integrator,
+                                    const vector<std::string>& files) {
+        std::string key = scene + "|" + integrator;
+        for (const std::string& file : files) {
+            key += "|";
+            if (file.empty()) {
+                key += "-";
+                continue;
+            }
+            key += file;
+            std::error_code error;
+            auto size = std::filesystem::file_size(file, error);
+            if (!error) key += "@" + std::to_string(size);
+            auto time = std::filesystem::last_write_time(file, error);
+            if (!error)
+                key += "@" + std::to_string(time.time_since_epoch().count());
+        }
+        for (char& c : key)
+            if (std::isspace(static_cast<unsigned char>(c))) c = '_';
+        return key;
+    }
+
+    // Settings for the scene stored under key, tuned now and added to the
+    // cache file unless an earlier run already did.
+    TunedSettings settings(const std::string& key, const Scene& scene,
+                           const RenderOption& option) {
+        TunedSettings result;
+        if (load(key, result)) return result;
+        result = tune(scene, option);
+        store(key, result);
+        return result;
+    }
+
+    // Calibrate without the cache. option supplies the integrator and path
+    // depth; path guiding and caustic photons are left out.
+    TunedSettings tune(const Scene& scene, RenderOption option) const {
+        TRACE_SCOPE("auto-tune");
+        option.samples_per_pixel = samples_per_pixel;
+        option.show_progress = false;
+        option.path_guiding = false;
+        option.caustic_photons = 0;
+
+        std::set<unsigned int> threads = {Host::physical_cores(),
+                                          Host::hardware_threads()};
+        TunedSettings best;
+        best.threads = *threads.rbegin();
+        best.leaf_size = scene.bvh.leaf_size();
+        Scene candidate = scene;
+        // Warm up caches and page in anything loaded lazily. The better of
+        // its two runs is warm, so it scores the starting settings that
+        // every candidate has to beat.
+        best.rays_per_second = measure(candidate, best, option);
+
+        auto try_value = [&](auto parameter, auto value) {
+            TunedSettings settings = best;
+            settings.*parameter = value;
+            if (settings.leaf_size != candidate.bvh.leaf_size())
+                candidate.rebuild_bvh(settings.leaf_size);
+            settings.rays_per_second = measure(candidate, settings, option);
+            if (settings.rays_per_second > best.rays_per_second)
+                best = settings;
+        };
+
+        for (unsigned int t : threads) try_value(&TunedSettings::threads, t);
+        for (int l : leaf_sizes) try_value(&TunedSettings::leaf_size, l);
+        for (int t : tile_sizes) try_value(&TunedSettings::tile_size, t);
+        return best;
+    }
+
+   private:
+    // Rays per second rendering scene with settings, the better of two
+    // runs.
+    double measure(const Scene& scene, const TunedSettings& settings,
+                   RenderOption option) const {
+        option.threads = settings.threads;
+        option.tile_size = settings.tile_size;
+        CPU_MT_Renderer renderer(scene);
+        double best = 0;
+        for (int run = 0; run < 2; ++run) {
+            Film film(width, height);
+            uint64_t rays = RayStats::total_rays;
+            auto start = std::chrono::steady_clock::now();
+            renderer.accumulate(option, film);
+            double seconds = std::chrono::duration<double>(
+                                 std::chrono::steady_clock::now() - start)
+                                 .count();
+            if (seconds > 0)
+                best = std::max(best, (RayStats::total_rays - rays) / seconds);
+        }
+        return best;
+    }
+
+    // Cache lines hold a key and its settings: threads, tile size, leaf
+    // size and calibration rays per second.
+    bool load(const std::string& key, TunedSettings& settings) const {
+        std::ifstream file(_cache_file);
+        std::string line;
+        while (std::getline(file, line)) {
+            std::istringstream in(line);
+            std::string k;
+            TunedSettings s;
+            if (!(in >> k >> s.threads >> s.tile_size >> s.leaf_size >>
+                  s.rays_per_second) ||
+                k != key)
+                continue;
+            // A machine that lost hardware threads since needs a new run.
+            if (s.threads == 0 || s.threads > Host::hardware_threads())
+                return false;
+            settings = s;
+            return true;
+        }
+        return false;
+    }
+
+    void store(const std::string& key, const TunedSettings& settings) const {
+        vector<std::string> lines;
+        {
+            std::ifstream file(_cache_file);
+            std::string line, k;
+            while (std::getline(file, line)) {
+                std::istringstream in(line);
+                if (in >> k && k != key) lines.push_back(line);
+            }
+        }
+        std::ofstream file(_cache_file);
+        if (!file) {
+            std::cerr << "Cannot write " << _cache_file << std::endl;
+            return;
+        }
+        for (const auto& line : lines) file << line << '\n';
+        file << key << ' ' << settings.threads << ' ' << settings.tile_size
+             << ' ' << settings.leaf_size << ' ' << settings.rays_per_second
+             << '\n';
+    }
+};
@@ -1,13 +1,26 @@
 #pragma once
 
+#include <stdexcept>
+
+#include "Frustum.h"
 #include "Ray.h"
+#include "RayPacket.h"
 #include "Vector.h"
 
 class Camera {
    public:
-    Camera(Point3d lookfrom, Point3d lookat, Vec3d vup, double vfov,
-           double aspect_ratio, double aperture, double focus_dist) {
+    // The shutter is open over [shutter_open, shutter_close], within the
+    // interval [0, 1] moving objects are keyframed over. By default it
+    // opens for an instant at 0 and nothing blurs.
+    Camera(Point3 lookfrom, Point3 lookat, Vec3 vup, Real vfov,
+           Real aspect_ratio, Real aperture, Real focus_dist,
+           Real shutter_open = 0, Real shutter_close = 0)
+        : _shutter_open(shutter_open), _shutter_close(shutter_close) {
+        if (!(0 <= shutter_open && shutter_open <= shutter_close &&
+              shutter_close <= 1))
+            throw std::runtime_error("Shutter interval outside [0, 1]");
         auto theta = Math::deg_to_rad(vfov);
+        _vfov = theta;
         auto h = tan(theta / 2);
         auto viewport_height = 2.0 * h;
         auto viewport_width = aspect_ratio * viewport_height;
@@ -25,19 +38,58 @@ class Camera {
         _lens_radius = aperture / 2;
     }
 
-    Ray get_ray(double s, double t) const {
-        Vec3d rd = _lens_radius * Math::random_in_unit_disk();
-        Vec3d offset = u * rd.x() + v * rd.y();
+    // Where a camera ray leaves the lens and when: a point of the unit
+    // disk, scaled by the lens radius, and a time while the shutter is
+    // open.
+    struct LensSample {
+        Real x, y;
+        Real time;
+    };
+
+    LensSample sample_lens() const {
+        Vec3 p = Math::random_in_unit_disk();
+        return {p.x(), p.y(), sample_time()};
+    }
+
+    Ray get_ray(Real s, Real t) const { return get_ray(s, t, sample_lens()); }
+
+    // The ray through (s, t) from the given lens sample, the same every
+    // time.
+    Ray get_ray(Real s, Real t, const LensSample& lens) const {
+        Vec3 offset = _lens_radius * (u * lens.x + v * lens.y);
+
+        return Ray(_origin + offset,
+                   _lower_left_corner + s * _horizontal + t * _vertical -
+                       _origin - offset,
+                   lens.time);
+    }
+
+    // Uniformly distributed time while the shutter is open.
+    Real sample_time() const {
+        if (_shutter_close <= _shutter_open) return _shutter_open;
+        return _shutter_open +
+               Math::random_double() * (_shutter_close - _shutter_open);
+    }
+
+    // Vertical field of view in radians.
+    Real vertical_fov() const { return _vfov; }
 
-        return Ray(_origin + offset, _lower_left_corner + s * _horizontal +
-                                         t * _vertical - _origin - offset);
+    // Build the frustum of a packet of rays from get_ray. Fails only for
+    // packets too wide to bound, e.g. beyond a 180 degree field of view.
+    bool bound_packet(RayPacket& packet) const {
+        packet.coherent =
+            packet.frustum.bound(packet.rays, _origin, u, v, -w);
+        return packet.coherent;
     }
 
    private:
-    Point3d _origin;
-    Point3d _lower_left_corner;
-    Vec3d _horizontal;
-    Vec3d _vertical;
-    double _lens_radius;
-    Vec3d u, v, w;
+    Point3 _origin;
+    Point3 _lower_left_corner;
+    Vec3 _horizontal;
+    Vec3 _vertical;
+    Real _lens_radius;
+    Real _vfov;
+    Real _shutter_open;
+    Real _shutter_close;
+    Vec3 u, v, w;
 };
\ No newline at end of file
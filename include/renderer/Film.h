@@ -0,0 +1,55 @@
+#pragma once
+
+#include <algorithm>
+
+#include "Color.h"
+#include "HDRImage.h"
+#include "Image.h"
+
+// Running sum of radiance samples per pixel. Renderers accumulate sample
+// passes into a film so a render can be continued or stopped at any time.
+// Sums are kept in double whatever Real is, so long renders do not lose
+// the last samples to rounding.
+class Film {
+   public:
+    using Sum = Vec<double, 3>;
+
+    int width;
+    int height;
+    int samples = 0;
+    vector<Sum> sum;
+
+   public:
+    Film(int width, int height)
+        : width(width), height(height), sum(width * height) {}
+
+    // y counts rows from the top, as in Image::data.
+    void add(int x, int y, const Color& color) {
+        sum[y * width + x] += Sum(color);
+    }
+
+    void clear() {
+        samples = 0;
+        std::fill(sum.begin(), sum.end(), Sum{0, 0, 0});
+    }
+
+    // Mean radiance per pixel.
+    HDR_Image average() const {
+        HDR_Image image(width, height);
+        double scale = samples > 0 ? 1.0 / samples : 0.0;
+        for (size_t i = 0; i < sum.size(); ++i) {
+            image.data[i] = Color(sum[i] * scale);
+        }
+        return image;
+    }
+
+    // Gamma corrected 8 bit output.
+    void resolve(Image& output) const {
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                output.data[y][x] = color_to_rgb<ComponentType>(
+                    Color(sum[y * width + x]), std::max(samples, 1));
+            }
+        }
+    }
+};
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "Color.h"
+#include "Common.h"
+#include "Geometry.h"
+#include "Material.h"
+#include "PhotonMap.h"
+#include "SDTree.h"
+#include "Scene.h"
+
+// Rays traced by each thread, folded into total_rays when a pass finishes.
+namespace RayStats {
+inline std::atomic<uint64_t> total_rays{0};
+inline thread_local uint64_t thread_rays = 0;
+
+inline void flush() {
+    total_rays.fetch_add(thread_rays, std::memory_order_relaxed);
+    thread_rays = 0;
+}
+}  // namespace RayStats
+
+// Spread angle a ray cone takes on at a diffuse bounce. Texture lookups past
+// one only need coarse mip levels.
+const Real DIFFUSE_CONE_SPREAD = 0.2;
+
+// Fraction of diffuse scattering directions drawn from the path guide once
+// it has learned something.
+const Real GUIDE_SAMPLING_FRACTION = 0.5;
+
+// Shadow rays to points on emitters stop this fraction short of them.
+const Real SHADOW_EPSILON = 1e-4;
+
+// What a path needs to know besides the scene.
+struct PathContext {
+    const Scene& scene;
+    // Angle of the ray cone around camera rays, for texture footprints.
+    Real spread = 0;
+    // Learned incident radiance used to guide diffuse scattering, or null.
+    SDTree* guide = nullptr;
+    // Caustic photons and their gather radius, or null.
+    const PhotonMap* caustics = nullptr;
+    Real caustic_radius = 0;
+};
+
+// Next event estimation towards a point on an emitter, picked for rec by
+// the scene's light BVH. Returns the radiance the point sends to rec if
+// nothing is in between, sets direction towards it and pdf to the solid
+// angle density of direction. pdf stays 0 when there is nothing to add.
+inline Color sample_emitter(const Scene& scene, const HitRecord& rec,
+                            Vec3& direction, Real& pdf) {
+    pdf = 0;
+    Real pmf;
+    const Geometry* light = scene.lights.sample(rec.point, rec.normal,
+                                                Math::random_double(), pmf);
+    if (!light) return Color{0, 0, 0};
+
+    HitRecord light_rec;
+    light_rec.time = rec.time;
+    light_rec.point = light->sample_point(light_rec.normal, rec.time);
+    // Sampled points carry no error bound; allow a few ulps of their
+    // coordinates, as for hits.
+    light_rec.error = Math::gamma(8) * Math::abs(light_rec.point);
+    Vec3 to_light = light_rec.point - rec.point;
+    Real distance2 = to_light.length_squared();
+    if (!(distance2 > 0)) return Color{0, 0, 0};
+    direction = to_light / sqrt(distance2);
+    Real cosine = -direction.dot(light_rec.normal);
+    light_rec.front_face = cosine > 0;
+    Color emitted = light->material()->emitted(light_rec);
+    if (luminance(emitted) <= 0) return Color{0, 0, 0};
+
+    // Shadow ray between both end points pushed off their surfaces.
+    Point3 from = rec.spawn_ray(to_light).origin();
+    Point3 to = light_rec.spawn_ray(-to_light).origin();
+    ++RayStats::thread_rays;
+    if (scene.bvh.occluded(Ray(from, to - from, rec.time), 0,
+                           1 - SHADOW_EPSILON))
+        return Color{0, 0, 0};
+    pdf = pmf * distance2 / (fabs(cosine) * light->area());
+    return emitted;
+}
+
+// Density with which sample_emitter, called at point p with normal n, finds
+// the emitter hit rec along r. 0 if rec is not on one of the scene's
+// lights.
+inline Real emitter_pdf(const Scene& scene, const Point3& p, const Vec3& n,
+                        const Ray& r, const HitRecord& rec) {
+    if (!rec.object) return 0;
+    Real pmf = scene.lights.pmf(p, n, rec.object);
+    if (pmf <= 0) return 0;
+    Real distance2 = (rec.point - p).length_squared();
+    Real cosine = fabs(r.direction().unit_vector().dot(rec.normal));
+    return pmf * distance2 / (cosine * rec.object->area());
+}
+
+// Radiance along r once its closest hit is known. hit is false when r
+// leaves the scene; depth counts r among the rays a path may still trace.
+// Diffuse hits sample the background directly when it supports sampling,
+// and an emitter picked by the light BVH, and each is weighted against BSDF
+// sampling with the power heuristic. Scattering in participating media
+// comes back from the BVH as a hit with a phase function and is shaded the
+// same way. With a guide, diffuse scattering mixes BSDF sampling with the
+// learned distribution, and while the guide trains the light found along
+// each diffuse bounce is splatted back into it. With caustic photons, the
+// first diffuse hit gathers them, and light the path then reaches through
+// specular bounces alone is skipped since the photons already carry it.
+inline Color shade_hit(Ray r, bool hit, HitRecord rec,
+                       const PathContext& context, int depth) {
+    const Scene& scene = context.scene;
+    const Background& background = *scene.background;
+    SDTree* guide = context.guide;
+    bool training = guide && guide->training();
+    Real spread = context.spread;
+
+    Color radiance{0, 0, 0};
+    Color throughput{1, 1, 1};
+    bool specular = true;  // Nothing but BSDF sampling could find r
+    Real bsdf_pdf = 0;
+    // Diffuse vertex r left from, for weighting emitters it reaches.
+    Point3 last_point;
+    Vec3 last_normal;
+    Real cone_width = 0;
+    bool gathered = false;
+    // Specular bounces since the diffuse hit that gathered photons, or -1
+    // once the path has left it through a diffuse bounce.
+    int caustic_bounces = -1;
+
+    // Diffuse vertices of the path and the luminance reaching them along
+    // the direction they scattered into.
+    struct GuideVertex {
+        Point3 point;
+        Vec3 direction;
+        Color throughput;
+        Real pdf;
+        Real radiance;
+    };
+    thread_local vector<GuideVertex> vertices;
+    vertices.clear();
+    auto add_radiance = [&](const Color& contribution) {
+        radiance += contribution;
+        // Radiance arriving at each vertex, divided out channel by channel
+        // so coloured throughput does not skew what the guide learns.
+        for (auto& v : vertices) {
+            Color incident{0, 0, 0};
+            for (size_t c = 0; c < 3; ++c) {
+                if (v.throughput[c] > 0)
+                    incident[c] = contribution[c] / v.throughput[c];
+            }
+            v.radiance += luminance(incident);
+        }
+    };
+
+    for (;;) {
+        if (!hit) {
+            Real weight = 1;
+            if (!specular && background.can_sample())
+                weight = Math::power_heuristic(
+                    bsdf_pdf, background.pdf(r.direction()));
+            if (caustic_bounces <= 0)
+                add_radiance(throughput *
+                             background.radiance(r.direction()) * weight);
+            break;
+        }
+
+        cone_width += spread * rec.t * r.direction().length();
+        rec.footprint = cone_width;
+        const Material& material = *rec.material;
+        if (material.is_emissive() && caustic_bounces <= 0) {
+            Real weight = 1;
+            if (!specular)
+                weight = Math::power_heuristic(
+                    bsdf_pdf,
+                    emitter_pdf(scene, last_point, last_normal, r, rec));
+            add_radiance(throughput * material.emitted(rec) * weight);
+        }
+        if (depth <= 1) break;
+
+        bool gather = context.caustics && !gathered &&
+                      !material.is_specular() && !material.is_emissive() &&
+                      !material.is_volume();
+        if (gather) {
+            gathered = true;
+            Real radius = context.caustic_radius;
+            Color caustic{0, 0, 0};
+            context.caustics->lookup(
+                rec.point, radius, [&](const Photon& photon, Real) {
+                    Vec3 direction = -photon.incoming();
+                    Real cosine = direction.dot(rec.normal);
+                    if (cosine <= 0) return;
+                    caustic += material.eval(r, rec, direction) / cosine *
+                               photon.flux();
+                });
+            add_radiance(throughput * caustic / (Math::PI * radius * radius));
+        }
+        const DTree* dtree = nullptr;
+        if (guide && !material.is_specular()) {
+            dtree = &guide->sampling_tree(rec.point);
+            if (dtree->total() <= 0) dtree = nullptr;
+        }
+        // Density of the diffuse scattering strategy in use at this hit.
+        auto scatter_pdf = [&](const Vec3& direction) -> Real {
+            Real p = material.pdf(r, rec, direction);
+            if (!dtree) return p;
+            return GUIDE_SAMPLING_FRACTION * dtree->pdf(direction) +
+                   (1 - GUIDE_SAMPLING_FRACTION) * p;
+        };
+
+        if (!material.is_specular() && background.can_sample()) {
+            Vec3 direction;
+            Real light_pdf;
+            Color light = background.sample(direction, light_pdf);
+            Color f = material.eval(r, rec, direction);
+            if (light_pdf > 0 && luminance(f) > 0) {
+                ++RayStats::thread_rays;
+                if (!scene.bvh.occluded(rec.spawn_ray(direction), 0,
+                                        Math::INF)) {
+                    Real weight = Math::power_heuristic(
+                        light_pdf, scatter_pdf(direction));
+                    add_radiance(throughput * f * light *
+                                 (weight / light_pdf));
+                }
+            }
+        }
+
+        if (!material.is_specular() && !material.is_emissive() &&
+            !scene.lights.empty()) {
+            Vec3 direction;
+            Real light_pdf;
+            Color light = sample_emitter(scene, rec, direction, light_pdf);
+            if (light_pdf > 0) {
+                Color f = material.eval(r, rec, direction);
+                Real weight = Math::power_heuristic(light_pdf,
+                                                    scatter_pdf(direction));
+                add_radiance(throughput * f * light * (weight / light_pdf));
+            }
+        }
+
+        Ray scattered;
+        Color attenuation;
+        specular = material.is_specular();
+        if (dtree) {
+            if (Math::random_double() < GUIDE_SAMPLING_FRACTION) {
+                scattered = rec.spawn_ray(dtree->sample());
+            } else if (!material.scatter(r, rec, attenuation, scattered)) {
+                break;
+            }
+            bsdf_pdf = scatter_pdf(scattered.direction());
+            Color f = material.eval(r, rec, scattered.direction());
+            if (!(bsdf_pdf > 0) || luminance(f) <= 0) break;
+            attenuation = f / bsdf_pdf;
+        } else {
+            if (!material.scatter(r, rec, attenuation, scattered)) break;
+            bsdf_pdf =
+                specular ? 0 : material.pdf(r, rec, scattered.direction());
+        }
+        throughput *= attenuation;
+        if (gather) {
+            caustic_bounces = 0;
+        } else if (!specular) {
+            caustic_bounces = -1;
+        } else if (caustic_bounces >= 0) {
+            ++caustic_bounces;
+        }
+        if (!specular) spread = std::max(spread, DIFFUSE_CONE_SPREAD);
+        if (training && !specular && bsdf_pdf > 0 && luminance(throughput) > 0)
+            vertices.push_back({rec.point, scattered.direction(), throughput,
+                                bsdf_pdf, 0.0});
+
+        last_point = rec.point;
+        last_normal = rec.normal;
+        r = scattered;
+        --depth;
+        ++RayStats::thread_rays;
+        hit = scene.bvh.hit(r, 0, Math::INF, rec);
+    }
+
+    for (const auto& v : vertices) {
+        guide->record(v.point, v.direction, v.radiance / v.pdf);
+    }
+    return radiance;
+}
+
+inline Color ray_color(const Ray& r, const PathContext& context, int depth) {
+    if (depth <= 0) return Color{0, 0, 0};
+    ++RayStats::thread_rays;
+    HitRecord rec;
+    bool hit = context.scene.bvh.hit(r, 0, Math::INF, rec);
+    return shade_hit(r, hit, rec, context, depth);
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+
+#include "Color.h"
+#include "Common.h"
+#include "Integrator.h"
+
+// What the renderer computes for each camera ray. Everything but Path is a
+// cheap preview for framing and look development.
+enum class IntegratorType {
+    Path,              // Full path tracing
+    Albedo,            // Surface color at the first hit
+    Normal,            // Shading normal at the first hit
+    Depth,             // Distance to the first hit
+    AmbientOcclusion,  // Unoccluded fraction of the hemisphere nearby
+    Direct,            // Light reaching the first hit in one bounce
+};
+
+inline IntegratorType integrator_by_name(const std::string& name) {
+    if (name == "path") return IntegratorType::Path;
+    if (name == "albedo") return IntegratorType::Albedo;
+    if (name == "normal") return IntegratorType::Normal;
+    if (name == "depth") return IntegratorType::Depth;
+    if (name == "ao") return IntegratorType::AmbientOcclusion;
+    if (name == "direct") return IntegratorType::Direct;
+    throw std::runtime_error("Unknown integrator: " + name);
+}
+
+// Preview value along r once its closest hit is known. distance is how far
+// ambient occlusion looks for occluders and the depth shown as white.
+// Normals and depth are squared so they survive the gamma of color_to_rgb
+// unchanged.
+inline Color shade_preview(IntegratorType type, const Ray& r, bool hit,
+                           HitRecord rec, const PathContext& context,
+                           Real distance) {
+    const Scene& scene = context.scene;
+    if (type == IntegratorType::Direct)
+        return shade_hit(r, hit, rec, PathContext{scene, context.spread}, 2);
+    if (!hit) {
+        if (type == IntegratorType::Albedo)
+            return scene.background->radiance(r.direction());
+        return Color{0, 0, 0};
+    }
+
+    switch (type) {
+        case IntegratorType::Albedo:
+            rec.footprint = context.spread * rec.t * r.direction().length();
+            return rec.material->albedo(rec);
+        case IntegratorType::Normal: {
+            // Points in media have no normal and show as gray.
+            Vec3 n = rec.normal.length_squared() > 0 ? rec.normal.unit_vector()
+                                                     : Vec3(0);
+            Color c = 0.5 * (n + Vec3(1));
+            return c * c;
+        }
+        case IntegratorType::Depth: {
+            Real d =
+                std::min<Real>(rec.t * r.direction().length() / distance, 1);
+            return Color(d * d);
+        }
+        case IntegratorType::AmbientOcclusion: {
+            Vec3 direction = rec.normal + Math::random_unit_vector();
+            if (direction.near_zero()) direction = rec.normal;
+            direction = direction.unit_vector();
+            ++RayStats::thread_rays;
+            bool occluded =
+                scene.bvh.occluded(rec.spawn_ray(direction), 0, distance);
+            return occluded ? Color{0, 0, 0} : Color{1, 1, 1};
+        }
+        default:
+            return Color{0, 0, 0};
+    }
+}
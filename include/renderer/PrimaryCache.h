@@ -0,0 +1,102 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+#include "Common.h"
+#include "Material.h"
+
+// Camera samples a film holds and what each hit first, kept so
+// Renderer::rerender can shade them again after material edits without
+// tracing them. A sample keeps the random numbers its camera ray was made
+// from, the index of the scene object it hit and that hit's material; the
+// ray is made again from those numbers and the full hit rebuilt by
+// intersecting that one object, which gives the same record at a fraction
+// of the memory. Room for a fixed number of samples per pixel is allocated
+// up front, memory_bytes(width, height, capacity) in all, and a render with
+// more samples than that throws instead of growing the cache.
+class PrimaryCache {
+   public:
+    struct Sample {
+        // Position within the pixel, from its lower left corner.
+        float dx, dy;
+        // Point of the unit lens disk and shutter time.
+        float lens_x, lens_y;
+        float time;
+        // Index among the scene's objects, -1 when the ray left the scene.
+        int32_t primitive = -1;
+        const Material* material = nullptr;
+    };
+
+    // Samples of one pixel.
+    struct Pixel {
+        const Sample* first;
+        const Sample* last;
+
+        const Sample* begin() const { return first; }
+        const Sample* end() const { return last; }
+    };
+
+    int width;
+    int height;
+    // Samples per pixel recorded, matching Film::samples when every pass
+    // of the film was rendered with the cache.
+    int samples = 0;
+
+   private:
+    int _capacity;
+    vector<Sample> _samples;
+    // Samples recorded of each pixel.
+    vector<int> _counts;
+
+   public:
+    PrimaryCache(int width, int height, int capacity)
+        : width(width),
+          height(height),
+          _capacity(capacity),
+          _samples(static_cast<size_t>(width) * height * capacity),
+          _counts(static_cast<size_t>(width) * height, 0) {}
+
+    static size_t memory_bytes(int width, int height, int capacity) {
+        size_t pixels = static_cast<size_t>(width) * height;
+        return pixels * (capacity * sizeof(Sample) + sizeof(int));
+    }
+
+    size_t memory_bytes() const {
+        return memory_bytes(width, height, _capacity);
+    }
+
+    // Samples per pixel there is room for.
+    int capacity() const { return _capacity; }
+
+    // y counts rows from the top, as in Film::add.
+    void add(int x, int y, const Sample& sample) {
+        size_t pixel = static_cast<size_t>(y) * width + x;
+        if (_counts[pixel] == _capacity)
+            throw std::length_error("Primary cache is full");
+        _samples[pixel * _capacity + _counts[pixel]++] = sample;
+    }
+
+    Pixel pixel(int x, int y) const {
+        size_t pixel = static_cast<size_t>(y) * width + x;
+        const Sample* first = _samples.data() + pixel * _capacity;
+        return {first, first + _counts[pixel]};
+    }
+
+    // Whether a sample of the pixel first hit one of materials.
+    bool shows(int x, int y, const vector<const Material*>& materials) const {
+        for (const auto& sample : pixel(x, y)) {
+            if (sample.material &&
+                std::find(materials.begin(), materials.end(),
+                          sample.material) != materials.end())
+                return true;
+        }
+        return false;
+    }
+
+    void clear() {
+        samples = 0;
+        std::fill(_counts.begin(), _counts.end(), 0);
+    }
+};
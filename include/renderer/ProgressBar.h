@@ -3,7 +3,7 @@
 #include <iostream>
 #include <string>
 
-void showProgressBar(double progress) {
+inline void showProgressBar(double progress) {
     std::cout << "\033[?25l";
     const int barWidth = 50;
     int filledWidth = static_cast<int>(progress * barWidth);
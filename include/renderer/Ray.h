@@ -5,15 +5,19 @@
 class Ray {
    public:
     Ray() {}
-    Ray(const Point3d& origin, const Point3d& direction)
-        : _origin(origin), _direction(direction) {}
+    Ray(const Point3& origin, const Point3& direction, Real time = 0)
+        : _origin(origin), _direction(direction), _time(time) {}
 
-    Point3d origin() const { return _origin; }
-    Vec3d direction() const { return _direction; }
+    Point3 origin() const { return _origin; }
+    Vec3 direction() const { return _direction; }
+    // Moment within the shutter interval [0, 1] the ray samples, which
+    // places moving objects.
+    Real time() const { return _time; }
 
-    Point3d at(double t) const { return _origin + t * _direction; }
+    Point3 at(Real t) const { return _origin + t * _direction; }
 
    private:
-    Point3d _origin;
-    Vec3d _direction;
+    Point3 _origin;
+    Vec3 _direction;
+    Real _time = 0;
 };
\ No newline at end of file
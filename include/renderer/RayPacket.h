@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Common.h"
+#include "Frustum.h"
+#include "Geometry.h"
+#include "Ray.h"
+
+// A bundle of neighbouring camera rays traced together. Traversal rejects
+// boxes outside the frustum for every ray at once.
+struct RayPacket {
+    vector<Ray> rays;
+    vector<Vec3> inv_directions;
+    vector<HitRecord> records;
+    vector<Real> t_max;
+    vector<char> hit;
+    Frustum frustum;
+    // False if the rays diverge too much to share a frustum; each ray is then
+    // traced on its own.
+    bool coherent = false;
+
+    size_t size() const { return rays.size(); }
+
+    void clear() { rays.clear(); }
+
+    void add(const Ray& ray) { rays.push_back(ray); }
+
+    // Reset per ray state before tracing.
+    void prepare() {
+        size_t n = rays.size();
+        inv_directions.resize(n);
+        records.resize(n);
+        t_max.assign(n, Math::INF);
+        hit.assign(n, 0);
+        for (size_t i = 0; i < n; ++i) {
+            Vec3 d = rays[i].direction();
+            inv_directions[i] = Vec3{1 / d[0], 1 / d[1], 1 / d[2]};
+        }
+    }
+};
@@ -0,0 +1,428 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+
+#include "Renderer.h"
+#include "WorkerPool.h"
+
+// Samples per pixel a render job adds to a tile at a time. Small rounds
+// keep tiles short, so a worker soon gets to switch to a more urgent job.
+const int JOB_ROUND_SAMPLES = 1;
+
+// Handle to a flag asking the render jobs that hold it to stop. Copies
+// share the flag, so one token can cancel several jobs.
+class CancelToken {
+   private:
+    struct State {
+        std::atomic<bool> cancelled{false};
+        std::mutex mutex;
+        vector<std::function<void()>> listeners;
+    };
+    shared_ptr<State> _state = make_shared<State>();
+
+   public:
+    void cancel() {
+        _state->cancelled = true;
+        vector<std::function<void()>> listeners;
+        {
+            std::lock_guard<std::mutex> lock(_state->mutex);
+            listeners.swap(_state->listeners);
+        }
+        for (const auto& listener : listeners) listener();
+    }
+
+    // A single atomic load, cheap enough to check between tiles.
+    bool cancelled() const {
+        return _state->cancelled.load(std::memory_order_relaxed);
+    }
+
+    // Call listener once the token is cancelled, right away if it already
+    // is.
+    void on_cancel(std::function<void()> listener) {
+        {
+            std::lock_guard<std::mutex> lock(_state->mutex);
+            if (!_state->cancelled) {
+                _state->listeners.push_back(std::move(listener));
+                return;
+            }
+        }
+        listener();
+    }
+};
+
+// Image of a renderer's camera rendered on a RenderQueue. The job adds its
+// samples in rounds of JOB_ROUND_SAMPLES per pixel, one tile at a time,
+// within the passes of Renderer::accumulate. Its progress is kept here, so
+// the image so far can be read at any time, and a cancelled job continues
+// where it stopped when resumed. Path guides and photon maps are the
+// renderer's, so a renderer serves one job at a time: from its creation
+// until it is done or destroyed, a cancelled job included.
+class RenderJob {
+   public:
+    enum class Status { Queued, Running, Done, Cancelled };
+
+   private:
+    friend class RenderQueue;
+
+    // State of the queue the job was submitted to.
+    struct Shared {
+        // Owned by the queue, which outlives the loops it posts.
+        std::weak_ptr<WorkerPool> pool;
+        std::mutex mutex;
+        // A job finished or stopped having tiles in flight.
+        std::condition_variable progress;
+        // Jobs not finished.
+        vector<shared_ptr<RenderJob>> jobs;
+        bool stop = false;
+    };
+
+    // Marks the renderer as serving a job for as long as it is held.
+    class Claim {
+       private:
+        Renderer* _renderer;
+
+       public:
+        explicit Claim(Renderer& renderer) : _renderer(&renderer) {
+            if (renderer._in_job.exchange(true))
+                throw std::logic_error("Renderer already serves a job");
+        }
+        Claim(const Claim&) = delete;
+        Claim& operator=(const Claim&) = delete;
+        ~Claim() { release(); }
+
+        void release() {
+            if (_renderer) _renderer->_in_job = false;
+            _renderer = nullptr;
+        }
+    };
+
+    shared_ptr<Renderer> _renderer;
+    Claim _claim;
+    RenderOption _option;
+    int _priority;
+    Film _film;
+    vector<View> _views;
+    vector<Tile> _tiles;
+    // Samples per pixel each tile holds.
+    vector<int> _tile_samples;
+
+    // Guarded by the mutex of _shared from here on.
+    shared_ptr<Shared> _shared;
+    CancelToken _token;
+    // Done or cancelled, otherwise queued or running.
+    Status _status = Status::Queued;
+    // Loop of the pool working on the job.
+    shared_ptr<WorkerPool::Loop> _loop;
+    // Samples per pixel of the passes not begun yet.
+    int _remaining;
+    RenderOption _pass;
+    bool _pass_open = false;
+    // Samples per pixel of the current pass not handed to a round yet.
+    int _pass_remaining = 0;
+    // Samples per pixel of the current round, and its next tile.
+    int _round = 0;
+    size_t _next_tile;
+    int _in_flight = 0;
+    // A worker is ending one pass and beginning the next.
+    bool _between_passes = false;
+    // Calls to image() waiting for the tiles in flight.
+    int _readers = 0;
+    // Posts the rest of the job once there are no readers, set when a loop
+    // ends while they hold back its tiles.
+    std::function<void()> _resume;
+
+   public:
+    RenderJob(shared_ptr<Renderer> renderer, const RenderOption& option,
+              int width, int height, int priority)
+        : _renderer(renderer),
+          _claim(*renderer),
+          _option(renderer->prepare(option)),
+          _priority(priority),
+          _film(width, height),
+          _remaining(_option.samples_per_pixel) {
+        if (width <= 0 || height <= 0)
+            throw std::invalid_argument("Render job of an empty image");
+        _views.push_back({&_renderer->scene().camera, &_film});
+        _tiles = Renderer::make_tiles(_views, _option.tile_size);
+        _tile_samples.assign(_tiles.size(), 0);
+        _next_tile = _tiles.size();
+    }
+
+    RenderJob(const RenderJob&) = delete;
+    RenderJob& operator=(const RenderJob&) = delete;
+
+    int priority() const { return _priority; }
+
+    Status status() const {
+        std::lock_guard<std::mutex> lock(_shared->mutex);
+        if (finished()) return _status;
+        return _in_flight > 0 || _between_passes ? Status::Running
+                                                 : Status::Queued;
+    }
+
+    // Samples per pixel every pixel has so far.
+    int samples() const {
+        std::lock_guard<std::mutex> lock(_shared->mutex);
+        return _film.samples;
+    }
+
+    // Stop the job after the tiles it is rendering now.
+    void cancel() {
+        CancelToken token;
+        {
+            std::lock_guard<std::mutex> lock(_shared->mutex);
+            token = _token;
+        }
+        token.cancel();
+    }
+
+    // Block until the job is done or cancelled, and return which.
+    Status wait() const {
+        std::unique_lock<std::mutex> lock(_shared->mutex);
+        _shared->progress.wait(lock, [this]() { return finished(); });
+        return _status;
+    }
+
+    // Mean radiance so far, each pixel averaged over the samples of its
+    // tile. Waits for the tiles being rendered, and holds back new ones
+    // meanwhile, so every tile is read whole.
+    HDR_Image image() {
+        std::unique_lock<std::mutex> lock(_shared->mutex);
+        ++_readers;
+        _shared->progress.wait(lock, [this]() { return _in_flight == 0; });
+        HDR_Image image(_film.width, _film.height);
+        for (size_t t = 0; t < _tiles.size(); ++t) {
+            const Tile& tile = _tiles[t];
+            double scale = _tile_samples[t] > 0 ? 1.0 / _tile_samples[t] : 0;
+            for (int y = tile.y0; y < tile.y1; ++y) {
+                for (int x = tile.x0; x < tile.x1; ++x) {
+                    size_t i = (_film.height - y - 1) * _film.width + x;
+                    image.data[i] = Color(_film.sum[i] * scale);
+                }
+            }
+        }
+        if (--_readers == 0 && _resume) {
+            auto resume = std::move(_resume);
+            _resume = nullptr;
+            resume();
+        }
+        return image;
+    }
+
+   private:
+    bool finished() const {
+        return _status == Status::Done || _status == Status::Cancelled;
+    }
+};
+
+// Render jobs sharing the threads of one WorkerPool. Each round of a job is
+// a loop of the pool at the job's priority, so whenever a thread finishes a
+// tile it takes the next tile of the most urgent job, with higher priority
+// first and earlier submissions first among equals. A job submitted with a
+// higher priority than those running thus starts within a tile of each
+// thread, and the jobs it preempts continue once it is done. Jobs check
+// their cancellation token between tiles.
+class RenderQueue {
+   private:
+    using Shared = RenderJob::Shared;
+    using Status = RenderJob::Status;
+
+    shared_ptr<WorkerPool> _pool;
+    shared_ptr<Shared> _shared = make_shared<Shared>();
+
+   public:
+    // Jobs on the threads of pool, which other work may share.
+    explicit RenderQueue(shared_ptr<WorkerPool> pool) : _pool(pool) {
+        _shared->pool = pool;
+    }
+
+    // Jobs on a pool of their own with threads threads, 0 for one per
+    // hardware thread.
+    explicit RenderQueue(unsigned int threads = 0)
+        : RenderQueue(make_shared<WorkerPool>(
+              threads, []() { TRACE_THREAD_NAME("render queue"); })) {}
+
+    RenderQueue(const RenderQueue&) = delete;
+    RenderQueue& operator=(const RenderQueue&) = delete;
+
+    // Jobs finish their tiles and end up cancelled.
+    ~RenderQueue() {
+        vector<shared_ptr<WorkerPool::Loop>> loops;
+        {
+            std::lock_guard<std::mutex> lock(_shared->mutex);
+            _shared->stop = true;
+            for (const auto& job : _shared->jobs) {
+                if (job->_loop) loops.push_back(job->_loop);
+            }
+        }
+        for (const auto& loop : loops) _pool->cancel(loop);
+
+        std::unique_lock<std::mutex> lock(_shared->mutex);
+        _shared->progress.wait(lock,
+                               [this]() { return _shared->jobs.empty(); });
+    }
+
+    // Render the camera of renderer's scene at width x height with option.
+    // Throws std::logic_error if the renderer serves another job.
+    shared_ptr<RenderJob> submit(shared_ptr<Renderer> renderer,
+                                 const RenderOption& option, int width,
+                                 int height, int priority = 0,
+                                 CancelToken token = CancelToken()) {
+        auto job = make_shared<RenderJob>(renderer, option, width, height,
+                                          priority);
+        job->_shared = _shared;
+        enqueue(job, token);
+        return job;
+    }
+
+    // Continue a cancelled job of this queue with a new token.
+    void resume(const shared_ptr<RenderJob>& job,
+                CancelToken token = CancelToken()) {
+        if (job->_shared != _shared)
+            throw std::invalid_argument("Job belongs to another queue");
+        {
+            std::lock_guard<std::mutex> lock(_shared->mutex);
+            if (_shared->stop || job->_status != Status::Cancelled)
+                throw std::logic_error("Only cancelled jobs can resume");
+        }
+        enqueue(job, token);
+    }
+
+   private:
+    void enqueue(const shared_ptr<RenderJob>& job, CancelToken token) {
+        {
+            std::lock_guard<std::mutex> lock(_shared->mutex);
+            job->_token = token;
+            job->_status = Status::Queued;
+            _shared->jobs.push_back(job);
+            schedule(_shared, job);
+        }
+
+        std::weak_ptr<Shared> weak_shared = _shared;
+        std::weak_ptr<RenderJob> weak_job = job;
+        token.on_cancel([weak_shared, weak_job]() {
+            auto shared = weak_shared.lock();
+            auto job = weak_job.lock();
+            if (!shared || !job) return;
+            shared_ptr<WorkerPool::Loop> loop;
+            {
+                std::lock_guard<std::mutex> lock(shared->mutex);
+                loop = job->_loop;
+            }
+            // Ends the job through its loop's done, without the lock.
+            auto pool = shared->pool.lock();
+            if (loop && pool) pool->cancel(loop);
+        });
+    }
+
+    // Post the next piece of job to the pool: the rest of the current
+    // round, a new round of the current pass, or the change to the next
+    // pass. Called with the lock held.
+    static void schedule(const shared_ptr<Shared>& shared,
+                         const shared_ptr<RenderJob>& job) {
+        auto done = [shared, job](std::exception_ptr error) {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            job->_loop = nullptr;
+            if (job->_next_tile == job->_tiles.size() && job->_round > 0) {
+                job->_film.samples += job->_round;
+                job->_round = 0;
+            }
+            // A job whose tile threw ends cancelled, as one stopped.
+            if (job->_token.cancelled() || shared->stop || error) {
+                finish(*shared, job, Status::Cancelled);
+            } else if (job->_remaining == 0 && job->_pass_remaining == 0 &&
+                       !job->_pass_open && job->_round == 0) {
+                finish(*shared, job, Status::Done);
+            } else if (job->_readers > 0) {
+                job->_resume = [shared, job]() { schedule(shared, job); };
+            } else {
+                schedule(shared, job);
+            }
+        };
+
+        if (job->_next_tile == job->_tiles.size() &&
+            job->_pass_remaining > 0) {
+            job->_round = std::min(job->_pass_remaining, JOB_ROUND_SAMPLES);
+            job->_pass_remaining -= job->_round;
+            job->_next_tile = 0;
+        }
+        // The queue and its pool are alive while it has unfinished jobs.
+        auto pool = shared->pool.lock();
+        if (job->_next_tile < job->_tiles.size()) {
+            job->_loop = pool->post(
+                job->_tiles.size() - job->_next_tile,
+                [shared, job](size_t) { render_tile(*shared, *job); },
+                job->_priority, done);
+        } else {
+            job->_loop = pool->post(
+                1, [shared, job](size_t) { next_pass(*shared, *job); },
+                job->_priority, done);
+        }
+    }
+
+    // Render the next tile of job's round. While calls to image() wait,
+    // the tile is left for a later loop instead, so the worker moves on to
+    // other work rather than waiting with them.
+    static void render_tile(Shared& shared, RenderJob& job) {
+        std::unique_lock<std::mutex> lock(shared.mutex);
+        if (job._readers > 0 || job._token.cancelled() || shared.stop)
+            return;
+        size_t index = job._next_tile++;
+        ++job._in_flight;
+        RenderOption round = job._pass;
+        round.samples_per_pixel = job._round;
+        lock.unlock();
+        {
+            TRACE_SCOPE_ARG("tile", "index", index);
+            job._renderer->render_tile(job._tiles[index], round, job._views);
+        }
+        RayStats::flush();
+        lock.lock();
+
+        --job._in_flight;
+        job._tile_samples[index] += round.samples_per_pixel;
+        shared.progress.notify_all();
+    }
+
+    // End the current pass of job and begin the next. Renderer::begin_pass
+    // may shoot photons, so it runs without the lock, and on the queue's
+    // pool at the job's priority.
+    static void next_pass(Shared& shared, RenderJob& job) {
+        std::unique_lock<std::mutex> lock(shared.mutex);
+        if (job._token.cancelled() || shared.stop) return;
+        job._between_passes = true;
+        bool open = job._pass_open;
+        int remaining = job._remaining;
+        lock.unlock();
+        if (open) job._renderer->end_pass(job._option);
+        RenderOption pass;
+        if (remaining > 0) {
+            auto pool = shared.pool.lock();
+            pass = job._renderer->begin_pass(job._option, remaining,
+                                             pool.get(), job._priority);
+        }
+        lock.lock();
+        job._between_passes = false;
+        job._pass_open = remaining > 0;
+        if (remaining > 0) {
+            job._pass = pass;
+            job._remaining -= pass.samples_per_pixel;
+            job._pass_remaining = pass.samples_per_pixel;
+        }
+    }
+
+    static void finish(Shared& shared, const shared_ptr<RenderJob>& job,
+                       Status status) {
+        job->_status = status;
+        if (status == Status::Done) job->_claim.release();
+        auto& jobs = shared.jobs;
+        jobs.erase(std::remove(jobs.begin(), jobs.end(), job), jobs.end());
+        shared.progress.notify_all();
+    }
+};
@@ -1,44 +1,500 @@
 #pragma once
 
 #include <atomic>
+#include <cmath>
+#include <functional>
+#include <stdexcept>
 #include <thread>
 
+#include "CausticTracer.h"
 #include "Color.h"
 #include "Common.h"
-#include "Geometry.h"
+#include "Film.h"
 #include "Image.h"
-#include "Material.h"
+#include "Integrator.h"
+#include "PhotonMap.h"
+#include "Preview.h"
+#include "PrimaryCache.h"
 #include "ProgressBar.h"
+#include "RayPacket.h"
+#include "SDTree.h"
 #include "Scene.h"
-
-Color ray_color(const Ray& r, const Geometry& world, int depth) {
-    if (depth <= 0) return Color{0, 0, 0};
-    HitRecord rec;
-    if (world.hit(r, 0.001, Math::INF, rec)) {
-        Ray scattered;
-        Color attenuation;
-        if (rec.material->scatter(r, rec, attenuation, scattered))
-            return attenuation * ray_color(scattered, world, depth - 1);
-        return Color{0, 0, 0};
-    }
-    Vec3d unit_direction = r.direction().unit_vector();
-    auto t = 0.5 * (unit_direction.y() + 1.0);
-    return (1.0 - t) * Color{1.0, 1.0, 1.0} + t* Color{0.5, 0.7, 1.0};
-}
+#include "Trace.h"
+#include "WorkerPool.h"
 
 struct RenderOption {
     int samples_per_pixel;
     int max_depth;
+    bool show_progress = true;
+    int tile_size = 32;
+    // Worker threads of CPU_MT_Renderer, 0 for one per hardware thread.
+    unsigned int threads = 0;
+    // Camera rays are traced in packets of packet_size^2 neighbouring
+    // pixels, 0 traces each camera ray on its own.
+    int packet_size = 8;
+    // Learn incident radiance over the first passes and guide diffuse
+    // scattering with it afterwards. The guide persists across calls to
+    // accumulate on the same renderer.
+    bool path_guiding = false;
+    // Photons shot per pass into a caustic photon map, 0 leaves caustics to
+    // path tracing. The gather radius starts at caustic_radius, or at a
+    // fraction of the scene size when 0, and shrinks with every pass on the
+    // same renderer so the estimate converges.
+    int caustic_photons = 0;
+    Real caustic_radius = 0;
+    // Previews ignore path guiding and caustic photons.
+    IntegratorType integrator = IntegratorType::Path;
+    // How far ambient occlusion looks and the depth shown as white, 0 picks
+    // a tenth of the scene size for the former and all of it for the latter.
+    Real preview_distance = 0;
+};
+
+// Samples per pixel rendered with one caustic photon map.
+const int CAUSTIC_PASS_SAMPLES = 4;
+
+// How much of its density progressive photon mapping keeps per pass; lower
+// values shrink the radius faster.
+const double CAUSTIC_RADIUS_ALPHA = 2.0 / 3.0;
+
+// Pixel rectangle [x0, x1) x [y0, y1) of a view, with y counting up from
+// the bottom row like the camera's v coordinate.
+struct Tile {
+    int x0, y0, x1, y1;
+    int view = 0;
+};
+
+// One image of a render: the camera it is seen through and the film its
+// samples go to, and optionally a cache that records the camera rays of
+// those samples for Renderer::rerender.
+struct View {
+    const Camera* camera;
+    Film* film;
+    PrimaryCache* cache = nullptr;
 };
 
+class RenderJob;
+class RenderQueue;
+
 class Renderer {
+    friend class RenderJob;
+    friend class RenderQueue;
+
    protected:
     Scene _scene;
+    shared_ptr<SDTree> _guide;
+    shared_ptr<CausticTracer> _caustic_tracer;
+    shared_ptr<PhotonMap> _caustics;
+    Real _caustic_radius = 0;
+    int _caustic_passes = 0;
+    // Held by the unfinished RenderJob of this renderer, if any.
+    std::atomic<bool> _in_job{false};
 
    public:
     Renderer(Scene scene) : _scene(scene) {}
     virtual ~Renderer() = default;
-    virtual void render(RenderOption option, Image& output) = 0;
+
+    // Add option.samples_per_pixel samples to every pixel of film. While a
+    // path guide trains, the samples are split into passes of doubling size
+    // with the guide refined in between. With caustic photons, every pass
+    // of CAUSTIC_PASS_SAMPLES gets a new photon map. This and the other
+    // renders throw std::logic_error while the renderer serves a RenderJob,
+    // whose passes use the same guide and photons.
+    void accumulate(RenderOption option, Film& film) {
+        accumulate(option, {View{&_scene.camera, &film}});
+    }
+
+    // The same for several views of the scene at once. Their tiles share
+    // one work queue, so threads move on to another view's tiles instead of
+    // waiting for the slowest tile of a view.
+    void accumulate(RenderOption option, const vector<View>& views) {
+        check_no_job();
+        for (const auto& view : views) {
+            if (view.cache && view.cache->samples + option.samples_per_pixel >
+                                  view.cache->capacity())
+                throw std::length_error("Primary cache too small for render");
+        }
+        option = prepare(option);
+        int remaining = option.samples_per_pixel;
+        while (remaining > 0) {
+            RenderOption pass =
+                begin_pass(option, remaining, pass_pool(option));
+            {
+                TRACE_SCOPE_ARG("sample pass", "samples",
+                                pass.samples_per_pixel);
+                render_pass(pass, views);
+            }
+            remaining -= pass.samples_per_pixel;
+            end_pass(option);
+        }
+    }
+
+    void render(RenderOption option, Image& output) {
+        check_no_job();
+        Film film(output.width, output.height);
+        accumulate(option, film);
+        film.resolve(output);
+    }
+
+    // Render the scene through every camera into the output of the same
+    // index.
+    void render(RenderOption option, const vector<Camera>& cameras,
+                const vector<Image*>& outputs) {
+        check_no_job();
+        if (cameras.size() != outputs.size())
+            throw std::invalid_argument("Need one output per camera");
+        vector<Film> films;
+        films.reserve(outputs.size());
+        vector<View> views;
+        for (size_t i = 0; i < cameras.size(); ++i) {
+            films.emplace_back(outputs[i]->width, outputs[i]->height);
+            views.push_back({&cameras[i], &films[i]});
+        }
+        accumulate(option, views);
+        for (size_t i = 0; i < films.size(); ++i) {
+            films[i].resolve(*outputs[i]);
+        }
+    }
+
+    // Shade the samples of view again after the parameters of changed
+    // materials were edited, starting from the first hits its cache holds:
+    // camera rays are made again from the cached samples but not traced,
+    // only the paths from their first bounce on. Every sample the film
+    // holds must be in the cache. A path guide steers the paths only once
+    // it is done training, and learns nothing from them. With shown_only,
+    // pixels none of whose samples first hit a changed material keep their
+    // samples, which suits edits that barely change the light other
+    // surfaces receive; otherwise every pixel is shaded again. Edits must
+    // leave geometry, the camera and emission alone, and no render may be
+    // running on the scene meanwhile.
+    void rerender(RenderOption option, const View& view,
+                  const vector<const Material*>& changed,
+                  bool shown_only = false) {
+        check_no_job();
+        const Film& film = *view.film;
+        if (!view.cache || view.cache->width != film.width ||
+            view.cache->height != film.height ||
+            view.cache->samples != film.samples)
+            throw std::invalid_argument(
+                "Rerender needs a cache of every sample of the film");
+        option = prepare(option);
+        if (option.caustic_photons > 0)
+            shoot_caustics(option, pass_pool(option), 0);
+        auto tiles = make_tiles({view}, option.tile_size);
+        TRACE_SCOPE("rerender");
+        for_each_tile(option, tiles, [&](size_t i) {
+            rerender_tile(tiles[i], option, view, changed, shown_only);
+        });
+    }
+
+    const Scene& scene() const { return _scene; }
+
+   protected:
+    void check_no_job() const {
+        if (_in_job) throw std::logic_error("Renderer serves a render job");
+    }
+
+    // option with what its integrator does not use turned off, and the
+    // path guide it needs created.
+    RenderOption prepare(RenderOption option) {
+        if (option.integrator != IntegratorType::Path) {
+            option.path_guiding = false;
+            option.caustic_photons = 0;
+        }
+        if (option.path_guiding && !_guide)
+            _guide = make_shared<SDTree>(_scene.bvh.primitive_bounds());
+        return option;
+    }
+
+    // Option of the next pass of a render with remaining samples per pixel
+    // left, after shooting the photons the pass uses on pool at priority.
+    // Its samples stop where the path guide or the caustic photons need
+    // refreshing.
+    RenderOption begin_pass(const RenderOption& option, int remaining,
+                            WorkerPool* pool, int priority = 0) {
+        RenderOption pass = option;
+        pass.samples_per_pixel = remaining;
+        if (option.path_guiding && _guide->training())
+            pass.samples_per_pixel =
+                std::min(remaining, _guide->pass_samples());
+        if (option.caustic_photons > 0) {
+            pass.samples_per_pixel =
+                std::min(pass.samples_per_pixel, CAUSTIC_PASS_SAMPLES);
+            shoot_caustics(option, pool, priority);
+        }
+        return pass;
+    }
+
+    // Learn from the samples of the pass that just ended.
+    void end_pass(const RenderOption& option) {
+        if (option.path_guiding) {
+            TRACE_SCOPE("guide refinement");
+            _guide->end_pass();
+        }
+    }
+
+    static unsigned int worker_threads(const RenderOption& option) {
+        if (option.threads > 0) return option.threads;
+        return std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    // Add option.samples_per_pixel samples to every pixel of every view.
+    void render_pass(const RenderOption& option, const vector<View>& views) {
+        auto tiles = make_tiles(views, option.tile_size);
+        for_each_tile(option, tiles, [&](size_t i) {
+            render_tile(tiles[i], option, views);
+        });
+        for (const auto& view : views) {
+            view.film->samples += option.samples_per_pixel;
+            if (view.cache) view.cache->samples += option.samples_per_pixel;
+        }
+    }
+
+    // Pool for the work of a pass besides its tiles, such as shooting
+    // photons, or null to do it on the calling thread.
+    virtual WorkerPool* pass_pool(const RenderOption&) { return nullptr; }
+
+    // Call render(i) for the index of every tile, showing progress if
+    // option asks for it.
+    virtual void for_each_tile(const RenderOption& option,
+                               const vector<Tile>& tiles,
+                               const std::function<void(size_t)>& render) = 0;
+
+    // Tiles of all views, taking turns between the views.
+    static vector<Tile> make_tiles(const vector<View>& views, int tile_size) {
+        tile_size = std::max(tile_size, 1);
+        vector<vector<Tile>> per_view;
+        size_t most = 0;
+        for (size_t v = 0; v < views.size(); ++v) {
+            int width = views[v].film->width, height = views[v].film->height;
+            vector<Tile> tiles;
+            for (int y = 0; y < height; y += tile_size) {
+                for (int x = 0; x < width; x += tile_size) {
+                    tiles.push_back({x, y, std::min(x + tile_size, width),
+                                     std::min(y + tile_size, height),
+                                     static_cast<int>(v)});
+                }
+            }
+            most = std::max(most, tiles.size());
+            per_view.push_back(std::move(tiles));
+        }
+
+        vector<Tile> tiles;
+        for (size_t i = 0; i < most; ++i) {
+            for (const auto& view_tiles : per_view) {
+                if (i < view_tiles.size()) tiles.push_back(view_tiles[i]);
+            }
+        }
+        return tiles;
+    }
+
+    void render_tile(const Tile& tile, const RenderOption& option,
+                     const vector<View>& views) const {
+        const Camera& camera = *views[tile.view].camera;
+        Film& film = *views[tile.view].film;
+        PathContext context{_scene, pixel_spread(camera, film),
+                            option.path_guiding ? _guide.get() : nullptr};
+        if (option.caustic_photons > 0) {
+            context.caustics = _caustics.get();
+            context.caustic_radius = _caustic_radius;
+        }
+        if (option.packet_size > 0) {
+            int step = option.packet_size;
+            RayPacket packet;
+            vector<PrimaryCache::Sample> samples;
+            for (int y = tile.y0; y < tile.y1; y += step) {
+                for (int x = tile.x0; x < tile.x1; x += step) {
+                    Tile block{x, y, std::min(x + step, tile.x1),
+                               std::min(y + step, tile.y1)};
+                    for (int s = 0; s < option.samples_per_pixel; ++s) {
+                        trace_packet(block, option, context, camera, film,
+                                     packet, samples,
+                                     views[tile.view].cache);
+                    }
+                }
+            }
+            return;
+        }
+
+        PrimaryCache* cache = views[tile.view].cache;
+        for (int y = tile.y0; y < tile.y1; ++y) {
+            for (int x = tile.x0; x < tile.x1; ++x) {
+                Color pixel_color{0, 0, 0};
+                for (int s = 0; s < option.samples_per_pixel; ++s) {
+                    PrimaryCache::Sample sample = camera_sample(camera);
+                    Ray ray = camera_ray(camera, x, y, film, sample);
+                    HitRecord rec;
+                    ++RayStats::thread_rays;
+                    bool hit = _scene.bvh.hit(ray, 0, Math::INF, rec);
+                    pixel_color += shade(ray, hit, rec, context, option);
+                    if (cache) record(*cache, x, y, sample, hit, rec);
+                }
+                film.add(x, film.height - y - 1, pixel_color);
+            }
+        }
+    }
+
+   private:
+    // Photon map for the next pass. The radius shrinks as in probabilistic
+    // progressive photon mapping (Knaus and Zwicker 2011), which lets the
+    // bias vanish as passes accumulate.
+    void shoot_caustics(const RenderOption& option, WorkerPool* pool,
+                        int priority) {
+        TRACE_SCOPE("caustic photons");
+        if (!_caustic_tracer) {
+            _caustic_tracer = make_shared<CausticTracer>(_scene);
+            AABB bounds = _scene.bvh.primitive_bounds();
+            Vec3 extent = bounds.empty() ? Vec3(2) : bounds.max - bounds.min;
+            _caustic_radius = option.caustic_radius > 0
+                                  ? option.caustic_radius
+                                  : 0.005 * extent.length();
+        } else {
+            _caustic_radius *= sqrt((_caustic_passes + CAUSTIC_RADIUS_ALPHA) /
+                                    (_caustic_passes + 1));
+        }
+        _caustics = make_shared<PhotonMap>(
+            _caustic_tracer->shoot(option.caustic_photons, pool, priority));
+        ++_caustic_passes;
+    }
+
+    // Estimate for a camera ray with its closest hit known.
+    Color shade(const Ray& r, bool hit, const HitRecord& rec,
+                const PathContext& context, const RenderOption& option) const {
+        if (option.integrator == IntegratorType::Path) {
+            if (option.max_depth <= 0) return Color{0, 0, 0};
+            return shade_hit(r, hit, rec, context, option.max_depth);
+        }
+
+        Real distance = option.preview_distance;
+        if (distance <= 0) {
+            AABB bounds = _scene.bvh.primitive_bounds();
+            distance = bounds.empty() ? 1 : (bounds.max - bounds.min).length();
+            if (option.integrator == IntegratorType::AmbientOcclusion)
+                distance *= 0.1;
+        }
+        return shade_preview(option.integrator, r, hit, rec, context,
+                             distance);
+    }
+
+    // Angle between the camera rays of neighbouring pixels.
+    static Real pixel_spread(const Camera& camera, const Film& film) {
+        return camera.vertical_fov() / film.height;
+    }
+
+    // Random numbers a camera ray is made from, kept in the form a
+    // PrimaryCache stores so a cached ray comes out the same when made
+    // again.
+    static PrimaryCache::Sample camera_sample(const Camera& camera) {
+        PrimaryCache::Sample sample;
+        sample.dx = static_cast<float>(Math::random_double());
+        sample.dy = static_cast<float>(Math::random_double());
+        Camera::LensSample lens = camera.sample_lens();
+        sample.lens_x = static_cast<float>(lens.x);
+        sample.lens_y = static_cast<float>(lens.y);
+        sample.time = static_cast<float>(lens.time);
+        return sample;
+    }
+
+    static Ray camera_ray(const Camera& camera, int x, int y,
+                          const Film& film,
+                          const PrimaryCache::Sample& sample) {
+        auto u = (x + Real(sample.dx)) / (film.width - 1);
+        auto v = (y + Real(sample.dy)) / (film.height - 1);
+        return camera.get_ray(u, v,
+                              {sample.lens_x, sample.lens_y, sample.time});
+    }
+
+    // One sample for every pixel of block, with the camera rays traced as a
+    // packet and the rest of each path traced on its own.
+    void trace_packet(const Tile& block, const RenderOption& option,
+                      const PathContext& context, const Camera& camera,
+                      Film& film, RayPacket& packet,
+                      vector<PrimaryCache::Sample>& samples,
+                      PrimaryCache* cache) const {
+        packet.clear();
+        samples.clear();
+        for (int y = block.y0; y < block.y1; ++y) {
+            for (int x = block.x0; x < block.x1; ++x) {
+                samples.push_back(camera_sample(camera));
+                packet.add(camera_ray(camera, x, y, film, samples.back()));
+            }
+        }
+        camera.bound_packet(packet);
+        _scene.bvh.hit_packet(packet, 0);
+        RayStats::thread_rays += packet.size();
+
+        size_t i = 0;
+        for (int y = block.y0; y < block.y1; ++y) {
+            for (int x = block.x0; x < block.x1; ++x, ++i) {
+                film.add(x, film.height - y - 1,
+                         shade(packet.rays[i], packet.hit[i],
+                               packet.records[i], context, option));
+                if (cache)
+                    record(*cache, x, y, samples[i], packet.hit[i],
+                           packet.records[i]);
+            }
+        }
+    }
+
+    // Keep the camera sample of pixel (x, y), y counting up as in tiles,
+    // and its first hit.
+    static void record(PrimaryCache& cache, int x, int y,
+                       PrimaryCache::Sample sample, bool hit,
+                       const HitRecord& rec) {
+        if (hit) {
+            sample.primitive = rec.primitive;
+            sample.material = rec.material;
+        }
+        cache.add(x, cache.height - y - 1, sample);
+    }
+
+    // First hit of a cached sample, found by intersecting the object it hit
+    // alone. Scattering in a medium is sampled anew, so those rays are
+    // traced again.
+    bool cached_hit(const PrimaryCache::Sample& sample, const Ray& ray,
+                    HitRecord& rec) const {
+        if (sample.primitive < 0) return false;
+        if (!(sample.material && sample.material->is_volume())) {
+            const auto& object = _scene.objects.objects()[sample.primitive];
+            if (object->hit(ray, 0, Math::INF, rec)) {
+                rec.primitive = sample.primitive;
+                return true;
+            }
+        }
+        ++RayStats::thread_rays;
+        return _scene.bvh.hit(ray, 0, Math::INF, rec);
+    }
+
+    void rerender_tile(const Tile& tile, const RenderOption& option,
+                       const View& view,
+                       const vector<const Material*>& changed,
+                       bool shown_only) const {
+        const Camera& camera = *view.camera;
+        Film& film = *view.film;
+        const PrimaryCache& cache = *view.cache;
+        // A guide still training would learn from these samples with no
+        // pass to end, so only one done training steers them.
+        bool guided = option.path_guiding && !_guide->training();
+        PathContext context{_scene, pixel_spread(camera, film),
+                            guided ? _guide.get() : nullptr};
+        if (option.caustic_photons > 0) {
+            context.caustics = _caustics.get();
+            context.caustic_radius = _caustic_radius;
+        }
+        for (int y = tile.y0; y < tile.y1; ++y) {
+            for (int x = tile.x0; x < tile.x1; ++x) {
+                int row = film.height - y - 1;
+                if (shown_only && !cache.shows(x, row, changed)) continue;
+                Film::Sum sum{0, 0, 0};
+                for (const auto& sample : cache.pixel(x, row)) {
+                    Ray ray = camera_ray(camera, x, y, film, sample);
+                    HitRecord rec;
+                    bool hit = cached_hit(sample, ray, rec);
+                    sum += Film::Sum(shade(ray, hit, rec, context, option));
+                }
+                film.sum[row * film.width + x] = sum;
+            }
+        }
+    }
 };
 
 using RendererPtr = shared_ptr<Renderer>;
@@ -46,87 +502,64 @@ using RendererPtr = shared_ptr<Renderer>;
 class CPU_ST_Renderer : public Renderer {
    public:
     CPU_ST_Renderer(Scene scene) : Renderer(scene) {}
-    void render(RenderOption option, Image& output) override {
-        int width = output.width;
-        int height = output.height;
-        int samples_per_pixel = option.samples_per_pixel;
-        int max_depth = option.max_depth;
-
-        for (int y = 0; y < height; ++y) {
-            showProgressBar(static_cast<double>(y) / height);
-            for (int x = 0; x < width; ++x) {
-                Color pixel_color{0, 0, 0};
-                for (int s = 0; s < samples_per_pixel; ++s) {
-                    auto u = (x + Math::random_double()) / (width - 1);
-                    auto v = (y + Math::random_double()) / (height - 1);
-                    Ray r = _scene.camera.get_ray(u, v);
-                    pixel_color += ray_color(r, _scene.objects, max_depth);
-                }
-                Pixel color =
-                    color_to_rgb<ComponentType>(pixel_color, samples_per_pixel);
-                output.data[height - y - 1][x] = color;
-            }
+   protected:
+    void for_each_tile(const RenderOption& option, const vector<Tile>& tiles,
+                       const std::function<void(size_t)>& render) override {
+        for (size_t i = 0; i < tiles.size(); ++i) {
+            if (option.show_progress)
+                showProgressBar(static_cast<double>(i) / tiles.size());
+            TRACE_SCOPE_ARG("tile", "index", i);
+            render(i);
         }
+        RayStats::flush();
     }
 };
 
+// Renders the tiles and shoots the photons of a pass on a WorkerPool, either
+// one it is given to share with other work or its own one, sized by
+// RenderOption::threads and kept from pass to pass.
 class CPU_MT_Renderer : public Renderer {
+   private:
+    shared_ptr<WorkerPool> _pool;
+    bool _own_pool;
+
    public:
-    CPU_MT_Renderer(Scene scene) : Renderer(scene) {}
-
-    void render(RenderOption option, Image& output) override {
-        int width = output.width;
-        int height = output.height;
-        int samples_per_pixel = option.samples_per_pixel;
-        int max_depth = option.max_depth;
-        unsigned int num_threads = std::thread::hardware_concurrency();
-
-        vector<std::thread> threads(num_threads);
-        std::atomic<int> completed_rows{0};
-
-        int rows_per_thread = height / num_threads;
-        int extra_rows = height % num_threads;
-        int start_y = 0;
-        int end_y = rows_per_thread;
-
-        for (unsigned int thread_id = 0; thread_id < num_threads; ++thread_id) {
-            if (extra_rows > 0) {
-                end_y++;
-                extra_rows--;
-            }
-            threads[thread_id] = std::thread([this, &output, &completed_rows,
-                                              thread_id, start_y, end_y, width,
-                                              height, samples_per_pixel,
-                                              max_depth]() {
-                for (int y = start_y; y < end_y; ++y) {
-                    ++completed_rows;
-                    for (int x = 0; x < width; ++x) {
-                        Color pixel_color{0, 0, 0};
-                        for (int s = 0; s < samples_per_pixel; ++s) {
-                            auto u = (x + Math::random_double()) / (width - 1);
-                            auto v = (y + Math::random_double()) / (height - 1);
-                            Ray r = _scene.camera.get_ray(u, v);
-                            pixel_color +=
-                                ray_color(r, _scene.objects, max_depth);
-                        }
-                        Pixel color = color_to_rgb<ComponentType>(
-                            pixel_color, samples_per_pixel);
-                        output.data[height - y - 1][x] = color;
-                    }
-                }
-            });
-            start_y = end_y;
-            end_y += rows_per_thread;
-        }
+    CPU_MT_Renderer(Scene scene, shared_ptr<WorkerPool> pool = nullptr)
+        : Renderer(scene), _pool(pool), _own_pool(!pool) {}
 
-        while (completed_rows < height - 1) {
-            showProgressBar(static_cast<double>(completed_rows) / (height - 1));
-            std::this_thread::sleep_for(std::chrono::duration<double>(0.5));
+   protected:
+    WorkerPool* pass_pool(const RenderOption& option) override {
+        unsigned int num_threads = worker_threads(option);
+        if (_own_pool && (!_pool || _pool->size() != num_threads)) {
+            _pool = make_shared<WorkerPool>(
+                num_threads, []() { TRACE_THREAD_NAME("worker"); });
         }
-        std::cout << std::endl;
+        return _pool.get();
+    }
 
-        for (auto& thread : threads) {
-            thread.join();
+    void for_each_tile(const RenderOption& option, const vector<Tile>& tiles,
+                       const std::function<void(size_t)>& render) override {
+        WorkerPool& pool = *pass_pool(option);
+
+        // Whichever thread takes a tile renders it; the calling thread also
+        // updates the progress bar between its tiles instead of polling.
+        size_t num_tiles = tiles.size();
+        std::atomic<size_t> completed_tiles{0};
+        std::thread::id caller = std::this_thread::get_id();
+        pool.parallel_for(num_tiles, [&](size_t i) {
+            {
+                TRACE_SCOPE_ARG("tile", "index", i);
+                render(i);
+            }
+            RayStats::flush();
+            ++completed_tiles;
+            if (option.show_progress && std::this_thread::get_id() == caller)
+                showProgressBar(static_cast<double>(completed_tiles) /
+                                num_tiles);
+        });
+        if (option.show_progress) {
+            showProgressBar(1);
+            std::cout << std::endl;
         }
     }
-};
\ No newline at end of file
+};
@@ -1,17 +1,46 @@
 #pragma once
 
+#include "BVH.h"
+#include "Background.h"
 #include "Camera.h"
 #include "Common.h"
 #include "GeometryList.h"
+#include "LightBVH.h"
+#include "Material.h"
 #include "Plane.h"
 #include "Sphere.h"
+#include "Trace.h"
 
 class Scene {
    public:
     Scene(Camera camera, GeometryList objects)
-        : camera(camera), objects(objects) {}
+        : camera(camera), objects(objects), bvh(build_bvh(objects)) {
+        for (const auto& object : objects.objects()) {
+            const auto& material = object->material();
+            if (material && material->is_emissive() && object->area() > 0)
+                emitters.push_back(object);
+        }
+        lights = LightBVH(emitters);
+    }
+
+    // Rebuild bvh with up to leaf_size objects per leaf.
+    void rebuild_bvh(int leaf_size) { bvh = build_bvh(objects, leaf_size); }
 
    public:
     Camera camera;
     GeometryList objects;
+    // Acceleration structure over objects, used for tracing.
+    BVH bvh;
+    BackgroundPtr background = make_shared<GradientSky>();
+    // Objects with an emissive material that can be sampled.
+    vector<shared_ptr<Geometry>> emitters;
+    // Emitters organized for picking one to sample at a shading point.
+    LightBVH lights;
+
+   private:
+    static BVH build_bvh(const GeometryList& objects,
+                         int leaf_size = BVH::DEFAULT_LEAF_SIZE) {
+        TRACE_SCOPE("BVH build");
+        return BVH(objects.objects(), leaf_size);
+    }
 };
\ No newline at end of file
@@ -1,13 +1,25 @@
 #pragma once
 
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include "ClusterFile.h"
 #include "Dielectric.h"
+#include "DiffuseLight.h"
+#include "EnvironmentMap.h"
+#include "GeometryCache.h"
+#include "GridMedium.h"
 #include "Lambertian.h"
 #include "Metal.h"
+#include "MovingGeometry.h"
 #include "Scene.h"
+#include "Texture.h"
+#include "Trace.h"
 
 class SceneBuilder {
-    using P = Point3d;
-    using V = Vec3d;
+    using P = Point3;
+    using V = Vec3;
     using C = Color;
 
    private:
@@ -18,6 +30,7 @@ class SceneBuilder {
 
    public:
     static Scene cornel_box() {
+        TRACE_SCOPE("SceneBuilder::cornel_box");
         GeometryList world;
         // Walls
         auto m_white_wall = ptr<Metal>(C{0.9, 0.9, 0.9}, 0.96);
@@ -48,9 +61,9 @@ class SceneBuilder {
         make_ball(P{-3, 2, -3.5}, 1.5, m_metal);    // right
         make_ball(P{0, 0, -3.5}, 1.5, m_glass);     // mid
         //  Camera
-        Point3d lookfrom{10, 0, 1};
-        Point3d lookat{0, 0, 0};
-        Vec3d vup{0, 0, 1};
+        Point3 lookfrom{10, 0, 1};
+        Point3 lookat{0, 0, 0};
+        Vec3 vup{0, 0, 1};
         auto dist_to_focus = 8.0;
         auto aperture = 0.01;
         double aspect_ratio = 16.0 / 9.0;
@@ -61,30 +74,53 @@ class SceneBuilder {
         return scene;
     }
 
-    static Scene random_spheres() {
+    // Layout is driven by its own generator so a seed always produces the
+    // same scene, which reference renders rely on. With moving, the small
+    // diffuse spheres bounce upwards while the shutter is open; their
+    // velocities come from a second generator so the layout stays that of
+    // the static scene.
+    static Scene random_spheres(unsigned int seed = 0, bool moving = false) {
+        TRACE_SCOPE("SceneBuilder::random_spheres");
         GeometryList world;
+        std::mt19937 generator(seed);
+        auto rand = [&](double min = 0.0, double max = 1.0) {
+            return std::uniform_real_distribution<double>(min, max)(generator);
+        };
+        std::mt19937 motion(seed ^ 0x9E3779B9u);
+        auto rand_velocity = [&] {
+            return V{0, std::uniform_real_distribution<double>(0, 0.5)(motion),
+                     0};
+        };
+        auto rand_color = [&](double min, double max) {
+            return C{rand(min, max), rand(min, max), rand(min, max)};
+        };
 
         auto ground_material = make_shared<Lambertian>(Color{0.5, 0.5, 0.5});
-        world.add(make_shared<Plane>(Point3d{0, 0, 0}, Point3d{0, 1, 0},
+        world.add(make_shared<Plane>(Point3{0, 0, 0}, Point3{0, 1, 0},
                                      ground_material));
 
         for (int a = -11; a < 11; a++) {
             for (int b = -11; b < 11; b++) {
-                auto choose_mat = Math::random_double();
-                Point3d center{a + 0.9 * Math::random_double(), 0.2,
-                               b + 0.9 * Math::random_double()};
+                auto choose_mat = rand();
+                Point3 center{a + 0.9 * rand(), 0.2, b + 0.9 * rand()};
 
-                if ((center - Point3d{4, 0.2, 0}).length() > 0.9) {
+                if ((center - Point3{4, 0.2, 0}).length() > 0.9) {
                     shared_ptr<Material> sphere_material;
 
                     if (choose_mat < 0.8) {
                         // diffuse
-                        auto albedo = Color::random() * Color::random();
+                        auto albedo = rand_color(0, 1) * rand_color(0, 1);
                         sphere_material = make_shared<Lambertian>(albedo);
+                        if (moving) {
+                            world.add(ptr<MovingGeometry>(
+                                ptr<Sphere>(center, 0.2, sphere_material),
+                                rand_velocity()));
+                            continue;
+                        }
                     } else if (choose_mat < 0.95) {
                         // metal
-                        auto albedo = Color::random(0.5, 1);
-                        auto fuzz = Math::random_double(0, 0.5);
+                        auto albedo = rand_color(0.5, 1);
+                        auto fuzz = rand(0, 0.5);
                         sphere_material = make_shared<Metal>(albedo, fuzz);
                     } else {
                         // glass
@@ -98,25 +134,262 @@ class SceneBuilder {
         }
 
         auto material1 = make_shared<Dielectric>(1.5);
-        world.add(make_shared<Sphere>(Point3d{0, 1, 0}, 1.0, material1));
+        world.add(make_shared<Sphere>(Point3{0, 1, 0}, 1.0, material1));
 
         auto material2 = make_shared<Lambertian>(Color{0.4, 0.2, 0.1});
-        world.add(make_shared<Sphere>(Point3d{-4, 1, 0}, 1.0, material2));
+        world.add(make_shared<Sphere>(Point3{-4, 1, 0}, 1.0, material2));
 
         auto material3 = make_shared<Metal>(Color{0.7, 0.6, 0.5}, 0.0);
-        world.add(make_shared<Sphere>(Point3d{4, 1, 0}, 1.0, material3));
+        world.add(make_shared<Sphere>(Point3{4, 1, 0}, 1.0, material3));
 
         // Camera
-        Point3d lookfrom{13, 2, 3};
-        Point3d lookat{0, 0, 0};
-        Vec3d vup{0, 1, 0};
+        Point3 lookfrom{13, 2, 3};
+        Point3 lookat{0, 0, 0};
+        Vec3 vup{0, 1, 0};
         auto dist_to_focus = 10.0;
         auto aperture = 0.1;
         double aspect_ratio = 16.0 / 9.0;
         Camera camera(lookfrom, lookat, vup, 20, aspect_ratio, aperture,
-                      dist_to_focus);
+                      dist_to_focus, 0, moving ? 1 : 0);
 
         Scene scene(camera, world);
         return scene;
     }
+
+    // random_spheres with motion blur.
+    static Scene moving_spheres(unsigned int seed = 0) {
+        return random_spheres(seed, true);
+    }
+
+    // Ground and three large spheres textured with a tiled texture file (see
+    // RayTracingTexture). Texture tiles share one cache of cache_bytes.
+    static Scene textured_spheres(const std::string& texture_file,
+                                  size_t cache_bytes = 64 << 20) {
+        TRACE_SCOPE("SceneBuilder::textured_spheres");
+        GeometryList world;
+        auto cache = make_shared<TextureCache>(cache_bytes);
+        auto texture = make_shared<ImageTexture>(cache, texture_file);
+
+        world.add(make_shared<Plane>(P{0, 0, 0}, V{0, 1, 0},
+                                     make_shared<Lambertian>(texture)));
+        world.add(make_shared<Sphere>(P{-4, 1, 0}, 1.0,
+                                      make_shared<Lambertian>(texture)));
+        world.add(make_shared<Sphere>(P{0, 1, 0}, 1.0,
+                                      make_shared<Metal>(texture, 0.2)));
+        world.add(make_shared<Sphere>(P{4, 1, 0}, 1.0,
+                                      make_shared<Lambertian>(texture)));
+
+        Camera camera(P{13, 2, 3}, P{0, 0, 0}, V{0, 1, 0}, 20, 16.0 / 9.0,
+                      0.1, 10.0);
+        return Scene(camera, world);
+    }
+
+    // Materials the records of sphere_field() refer to.
+    static vector<shared_ptr<Material>> sphere_field_materials() {
+        return {make_shared<Lambertian>(C{0.8, 0.3, 0.3}),
+                make_shared<Lambertian>(C{0.3, 0.8, 0.3}),
+                make_shared<Lambertian>(C{0.3, 0.3, 0.8}),
+                make_shared<Lambertian>(C{0.8, 0.8, 0.8}),
+                make_shared<Lambertian>(C{0.4, 0.2, 0.1}),
+                make_shared<Metal>(C{0.9, 0.8, 0.6}, 0.1),
+                make_shared<Metal>(C{0.7, 0.7, 0.7}, 0.4),
+                make_shared<Dielectric>(1.5)};
+    }
+
+    // count small spheres scattered over a square of ground centered on
+    // the origin, as records for a ClusterFile.
+    static vector<SphereRecord> sphere_field(size_t count,
+                                             unsigned int seed = 0) {
+        std::mt19937 generator(seed);
+        auto rand = [&](double min, double max) {
+            return std::uniform_real_distribution<double>(min, max)(generator);
+        };
+        double half_side = 0.3 * sqrt(static_cast<double>(count));
+        uint32_t materials =
+            static_cast<uint32_t>(sphere_field_materials().size());
+        vector<SphereRecord> spheres(count);
+        for (auto& s : spheres) {
+            s.radius = static_cast<float>(rand(0.08, 0.25));
+            s.center[0] = static_cast<float>(rand(-half_side, half_side));
+            s.center[1] = s.radius;
+            s.center[2] = static_cast<float>(rand(-half_side, half_side));
+            s.material = std::min(
+                static_cast<uint32_t>(rand(0, materials)), materials - 1);
+        }
+        return spheres;
+    }
+
+    // Ground and the spheres of a cluster file written from sphere_field(),
+    // paged in through cache as rays reach them. The camera looks across
+    // the field towards the horizon, so rays reach far clusters too.
+    static Scene paged_spheres(const std::string& geometry_file,
+                               shared_ptr<GeometryCache> cache) {
+        TRACE_SCOPE("SceneBuilder::paged_spheres");
+        GeometryList world;
+        auto ground = make_shared<Lambertian>(C{0.5, 0.5, 0.5});
+        world.add(make_shared<Plane>(P{0, 0, 0}, V{0, 1, 0}, ground));
+        auto file = cache->open(geometry_file, sphere_field_materials());
+        for (const auto& cluster : PagedCluster::all(cache, file)) {
+            world.add(cluster);
+        }
+
+        Camera camera(P{0, 1.2, 0}, P{10, 0.3, 4}, V{0, 1, 0}, 50,
+                      16.0 / 9.0, 0.0, 10.0);
+        return Scene(camera, world);
+    }
+
+    // random_spheres lit by a sun and sky environment map.
+    static Scene sunny_spheres(unsigned int seed = 0) {
+        TRACE_SCOPE("SceneBuilder::sunny_spheres");
+        Scene scene = random_spheres(seed);
+        scene.background = make_shared<EnvironmentMap>(
+            sun_sky(512, 256, V{-0.4, 0.6, -0.7}.unit_vector()));
+        return scene;
+    }
+
+    // random_spheres at night, lit only by count small glowing spheres
+    // scattered among the others. Total emitted power does not depend on
+    // count, so renders with different counts look alike and show how
+    // light sampling scales.
+    static Scene glowing_spheres(int count = 1000, unsigned int seed = 0) {
+        TRACE_SCOPE("SceneBuilder::glowing_spheres");
+        Scene scene = random_spheres(seed);
+        GeometryList world = scene.objects;
+        std::mt19937 generator(seed + 1);
+        auto rand = [&](double min, double max) {
+            return std::uniform_real_distribution<double>(min, max)(generator);
+        };
+        const double radius = 0.05;
+        double radiance = 4000.0 / std::max(count, 1);
+        for (int i = 0; i < count; ++i) {
+            C color{rand(0.3, 1), rand(0.3, 1), rand(0.3, 1)};
+            P center{rand(-11, 11), rand(radius, 2.5), rand(-11, 11)};
+            world.add(ptr<Sphere>(center, radius,
+                                  ptr<DiffuseLight>(color * radiance)));
+        }
+        Scene result(scene.camera, world);
+        result.background = ptr<UniformBackground>(C{0, 0, 0});
+        return result;
+    }
+
+    // random_spheres in a thin haze, with wisps of smoke drifting around
+    // the three large spheres.
+    static Scene foggy_spheres(unsigned int seed = 0) {
+        TRACE_SCOPE("SceneBuilder::foggy_spheres");
+        Scene scene = random_spheres(seed);
+        GeometryList world = scene.objects;
+        world.add(ptr<HomogeneousMedium>(
+            ptr<Sphere>(P{0, 0, 0}, 40.0, nullptr), 0.02, C{0.9, 0.9, 0.9}));
+        // Cells of 1/8 unit.
+        AABB bounds(P{-6, 0.8, -2}, P{6, 2.8, 2});
+        world.add(ptr<GridMedium>(box(bounds.min, bounds.max, nullptr),
+                                  bounds, 96, 16, 32, smoke(96, 16, 32, seed),
+                                  8.0, C{0.8, 0.8, 0.8}));
+        return Scene(scene.camera, world);
+    }
+
+    // Closed box of six rectangles with outward normals, for example to
+    // bound a medium.
+    static shared_ptr<GeometryList> box(const P& min, const P& max,
+                                        shared_ptr<Material> material) {
+        auto sides = ptr<GeometryList>();
+        P center = (min + max) * 0.5;
+        V half = (max - min) * 0.5;
+        for (int k = 0; k < 3; ++k) {
+            for (int sign : {-1, 1}) {
+                // Edges u and w with u x w = n, the winding Rectangle
+                // expects.
+                int i = (k + 1) % 3, j = (k + 2) % 3;
+                if (sign < 0) std::swap(i, j);
+                V n(0), u(0), w(0);
+                n[k] = sign;
+                u[i] = half[i];
+                w[j] = half[j];
+                P c = center + n * half[k];
+                sides->add(ptr<Rectangle>(
+                    std::array<P, 4>{c - u - w, c - u + w, c + u + w,
+                                     c + u - w},
+                    n, material));
+            }
+        }
+        return sides;
+    }
+
+    // Density samples for a GridMedium of cubic cells: soft puffs strung
+    // along the x axis, zero away from them so most of the
+    // grid is empty.
+    static vector<float> smoke(int nx, int ny, int nz,
+                               unsigned int seed = 0) {
+        std::mt19937 generator(seed);
+        auto rand = [&](double min, double max) {
+            return std::uniform_real_distribution<double>(min, max)(generator);
+        };
+        struct Puff {
+            V center;
+            double radius;
+        };
+        vector<Puff> puffs(120);
+        for (auto& puff : puffs) {
+            double x = rand(0.1, 0.9);
+            double y = 0.5 + 0.2 * sin(x * 4 * Math::PI) + rand(-0.1, 0.1);
+            puff = {V{x, y, 0.5 + 0.2 * cos(x * 3 * Math::PI)},
+                    rand(0.005, 0.015)};
+        }
+        // Offsets in units of the grid's extent along x.
+        V scale{1.0, double(ny) / nx, double(nz) / nx};
+        vector<float> density(static_cast<size_t>(nx) * ny * nz);
+        for (int z = 0; z < nz; ++z) {
+            for (int y = 0; y < ny; ++y) {
+                for (int x = 0; x < nx; ++x) {
+                    V p{(x + 0.5) / nx, (y + 0.5) / ny, (z + 0.5) / nz};
+                    double d = 0;
+                    for (const auto& puff : puffs) {
+                        V offset = (p - puff.center) * scale;
+                        d += exp(-offset.length_squared() /
+                                 (2 * puff.radius * puff.radius));
+                    }
+                    density[(static_cast<size_t>(z) * ny + y) * nx + x] =
+                        d > 0.05 ? static_cast<float>(d) : 0.0f;
+                }
+            }
+        }
+        return density;
+    }
+
+    // Procedural lat-long sky with a small, very bright sun disk. Most of
+    // the light comes from a few texels, the case light sampling is for.
+    static HDR_Image sun_sky(int width, int height, const V& sun_direction,
+                             double sun_radius = Math::deg_to_rad(1.5),
+                             double sun_radiance = 2000) {
+        HDR_Image image(width, height);
+        double cos_sun = cos(sun_radius);
+        for (int y = 0; y < height; ++y) {
+            double theta = Math::PI * (y + 0.5) / height;
+            for (int x = 0; x < width; ++x) {
+                double phi = 2 * Math::PI * (x + 0.5) / width - Math::PI;
+                V d{sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi)};
+                C sky;
+                if (d.y() < 0) {
+                    sky = C{0.3, 0.28, 0.25};
+                } else {
+                    double t = pow(1 - d.y(), 4);
+                    sky = (1 - t) * C{0.25, 0.45, 0.9} + t * C{0.8, 0.85, 0.95};
+                }
+                if (d.dot(sun_direction) >= cos_sun)
+                    sky = C{1.0, 0.95, 0.85} * sun_radiance;
+                image.at(x, y) = sky;
+            }
+        }
+        return image;
+    }
+
+    static Scene by_name(const std::string& name) {
+        if (name == "cornel_box") return cornel_box();
+        if (name == "random_spheres") return random_spheres();
+        if (name == "sunny_spheres") return sunny_spheres();
+        if (name == "glowing_spheres") return glowing_spheres();
+        if (name == "moving_spheres") return moving_spheres();
+        if (name == "foggy_spheres") return foggy_spheres();
+        throw std::runtime_error("Unknown scene: " + name);
+    }
 };
\ No newline at end of file
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cmath>
+
+#include "Color.h"
+#include "Common.h"
+#include "Geometry.h"
+#include "TextureCache.h"
+
+// Spatially varying material input, looked up at a hit.
+class Texture {
+   public:
+    virtual ~Texture() = default;
+    virtual Color value(const HitRecord& rec) const = 0;
+};
+
+using TexturePtr = shared_ptr<Texture>;
+
+class SolidColor : public Texture {
+   private:
+    Color _color;
+
+   public:
+    SolidColor(const Color& color) : _color(color) {}
+    Color value(const HitRecord& rec) const override { return _color; }
+};
+
+// Tiled texture read through a TextureCache. The mip level is chosen so one
+// texel roughly covers the ray footprint at the hit, which keeps distant
+// and indirect lookups on small, shared levels.
+class ImageTexture : public Texture {
+   private:
+    shared_ptr<TextureCache> _cache;
+    shared_ptr<TiledTexture> _texture;
+    double _scale;
+
+   public:
+    ImageTexture(shared_ptr<TextureCache> cache, const std::string& filename,
+                 double scale = 1.0)
+        : _cache(cache), _texture(cache->open(filename)), _scale(scale) {}
+
+    Color value(const HitRecord& rec) const override {
+        const TiledTexture& t = *_texture;
+        double texels =
+            rec.footprint / rec.uv_length * std::max(t.level(0).width,
+                                                     t.level(0).height);
+        int level = texels > 1 ? static_cast<int>(std::log2(texels)) : 0;
+        level = std::min(level, t.levels() - 1);
+
+        // Bilinear filtering within the level.
+        const TextureLevel& l = t.level(level);
+        double x = (rec.u - std::floor(rec.u)) * l.width - 0.5;
+        double y = (1 - (rec.v - std::floor(rec.v))) * l.height - 0.5;
+        int x0 = static_cast<int>(std::floor(x));
+        int y0 = static_cast<int>(std::floor(y));
+        double fx = x - x0, fy = y - y0;
+        Color c = (1 - fx) * (1 - fy) * _cache->texel(t, level, x0, y0) +
+                  fx * (1 - fy) * _cache->texel(t, level, x0 + 1, y0) +
+                  (1 - fx) * fy * _cache->texel(t, level, x0, y0 + 1) +
+                  fx * fy * _cache->texel(t, level, x0 + 1, y0 + 1);
+        return c * _scale;
+    }
+};
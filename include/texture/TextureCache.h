@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "Color.h"
+#include "Common.h"
+#include "ShardedCache.h"
+#include "TiledTexture.h"
+
+// Tiles of every texture of a scene, loaded on first use and evicted least
+// recently used first once the resident tiles exceed the memory budget. See
+// ShardedCache for how the budget is split and held.
+class TextureCache {
+   public:
+    using Stats = ShardedCache<vector<float>>::Stats;
+
+   private:
+    using TilePtr = ShardedCache<vector<float>>::Ptr;
+
+    ShardedCache<vector<float>> _tiles;
+    std::atomic<int> _next_id{0};
+
+   public:
+    explicit TextureCache(size_t budget_bytes)
+        : _tiles(budget_bytes, "texture tile") {}
+
+    size_t budget() const { return _tiles.budget(); }
+
+    // Open a tiled texture file for use with this cache. Only its header is
+    // read here.
+    shared_ptr<TiledTexture> open(const std::string& filename) {
+        return make_shared<TiledTexture>(filename, _next_id++);
+    }
+
+    // Texel (x, y) of a mip level, wrapping coordinates outside the level.
+    Color texel(const TiledTexture& t, int level, int x, int y) {
+        const TextureLevel& l = t.level(level);
+        x = ((x % l.width) + l.width) % l.width;
+        y = ((y % l.height) + l.height) % l.height;
+        int size = t.tile_size();
+        TilePtr tile = fetch(t, level, x / size, y / size);
+        const float* p = &(*tile)[((y % size) * size + x % size) * 3];
+        return Color{p[0], p[1], p[2]};
+    }
+
+    Stats stats() const { return _tiles.stats(); }
+
+   private:
+    TilePtr fetch(const TiledTexture& t, int level, int tile_x, int tile_y) {
+        uint64_t key = (static_cast<uint64_t>(t.id()) << 48) |
+                       (static_cast<uint64_t>(level) << 40) |
+                       (static_cast<uint64_t>(tile_x) << 20) |
+                       static_cast<uint64_t>(tile_y);
+        return _tiles.fetch(key, [&] {
+            return std::make_pair(
+                make_shared<const vector<float>>(
+                    t.read_tile(level, tile_x, tile_y)),
+                t.tile_bytes());
+        });
+    }
+};
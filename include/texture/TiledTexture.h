@@ -0,0 +1,158 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#include "Common.h"
+#include "HDRImage.h"
+
+struct TextureLevel {
+    int width;
+    int height;
+    int tiles_x;
+    int tiles_y;
+    int first_tile;  // Index of the level's first tile in the file
+};
+
+// Mip-mapped texture stored as square tiles of linear float RGB, so a
+// renderer can read the few tiles it needs instead of the whole image.
+//
+// Layout: "RTTX", then uint32 version, width, height, tile size and level
+// count, then tiles of every level in order, row by row. Edge tiles are
+// padded to the full tile size.
+class TiledTexture {
+   private:
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t HEADER_SIZE = 4 + 5 * sizeof(uint32_t);
+
+    std::string _filename;
+    int _id;
+    int _tile_size;
+    vector<TextureLevel> _levels;
+    mutable std::ifstream _file;
+    mutable std::mutex _mutex;
+
+   public:
+    // id tells textures apart in a TextureCache.
+    explicit TiledTexture(const std::string& filename, int id = 0)
+        : _filename(filename), _id(id) {
+        _file.open(filename, std::ios::binary);
+        if (!_file) throw std::runtime_error("Cannot open " + filename);
+
+        char magic[4];
+        uint32_t header[5];
+        _file.read(magic, 4);
+        _file.read(reinterpret_cast<char*>(header), sizeof(header));
+        if (!_file || std::string(magic, 4) != "RTTX" || header[0] != VERSION)
+            throw std::runtime_error("Not a tiled texture: " + filename);
+
+        _tile_size = static_cast<int>(header[3]);
+        _levels = layout(header[1], header[2], _tile_size, header[4]);
+    }
+
+    const std::string& filename() const { return _filename; }
+    int id() const { return _id; }
+    int tile_size() const { return _tile_size; }
+    int levels() const { return static_cast<int>(_levels.size()); }
+    const TextureLevel& level(int i) const { return _levels[i]; }
+    size_t tile_bytes() const { return tile_bytes(_tile_size); }
+
+    // Read one tile from disk. Safe to call from several threads.
+    vector<float> read_tile(int level, int tile_x, int tile_y) const {
+        const TextureLevel& l = _levels[level];
+        size_t index = l.first_tile + tile_y * l.tiles_x + tile_x;
+        vector<float> tile(_tile_size * _tile_size * 3);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _file.seekg(HEADER_SIZE + index * tile_bytes());
+        _file.read(reinterpret_cast<char*>(tile.data()), tile_bytes());
+        if (!_file) throw std::runtime_error("Truncated texture " + _filename);
+        return tile;
+    }
+
+    // Build the mip chain of image with a 2x2 box filter and write it.
+    static void write(const HDR_Image& image, const std::string& filename,
+                      int tile_size = 64) {
+        vector<HDR_Image> chain{image};
+        while (chain.back().width > 1 || chain.back().height > 1) {
+            chain.push_back(downsample(chain.back()));
+        }
+
+        std::ofstream outfile(filename, std::ios::binary);
+        if (!outfile) throw std::runtime_error("Cannot write " + filename);
+        uint32_t header[5] = {VERSION, static_cast<uint32_t>(image.width),
+                              static_cast<uint32_t>(image.height),
+                              static_cast<uint32_t>(tile_size),
+                              static_cast<uint32_t>(chain.size())};
+        outfile.write("RTTX", 4);
+        outfile.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+        auto levels = layout(image.width, image.height, tile_size,
+                             static_cast<int>(chain.size()));
+        vector<float> tile(tile_size * tile_size * 3);
+        for (size_t i = 0; i < levels.size(); ++i) {
+            const HDR_Image& level = chain[i];
+            for (int ty = 0; ty < levels[i].tiles_y; ++ty) {
+                for (int tx = 0; tx < levels[i].tiles_x; ++tx) {
+                    std::fill(tile.begin(), tile.end(), 0.0f);
+                    for (int y = 0; y < tile_size; ++y) {
+                        for (int x = 0; x < tile_size; ++x) {
+                            int sx = tx * tile_size + x;
+                            int sy = ty * tile_size + y;
+                            if (sx >= level.width || sy >= level.height)
+                                continue;
+                            const Color& c = level.at(sx, sy);
+                            float* t = &tile[(y * tile_size + x) * 3];
+                            t[0] = static_cast<float>(c.x());
+                            t[1] = static_cast<float>(c.y());
+                            t[2] = static_cast<float>(c.z());
+                        }
+                    }
+                    outfile.write(reinterpret_cast<const char*>(tile.data()),
+                                  tile_bytes(tile_size));
+                }
+            }
+        }
+    }
+
+   private:
+    static size_t tile_bytes(int tile_size) {
+        return static_cast<size_t>(tile_size) * tile_size * 3 * sizeof(float);
+    }
+
+    static vector<TextureLevel> layout(int width, int height, int tile_size,
+                                       int count) {
+        vector<TextureLevel> levels;
+        int first_tile = 0;
+        for (int i = 0; i < count; ++i) {
+            int tiles_x = (width + tile_size - 1) / tile_size;
+            int tiles_y = (height + tile_size - 1) / tile_size;
+            levels.push_back({width, height, tiles_x, tiles_y, first_tile});
+            first_tile += tiles_x * tiles_y;
+            width = std::max(width / 2, 1);
+            height = std::max(height / 2, 1);
+        }
+        return levels;
+    }
+
+    static HDR_Image downsample(const HDR_Image& image) {
+        HDR_Image result(std::max(image.width / 2, 1),
+                         std::max(image.height / 2, 1));
+        for (int y = 0; y < result.height; ++y) {
+            for (int x = 0; x < result.width; ++x) {
+                int x0 = std::min(2 * x, image.width - 1);
+                int x1 = std::min(2 * x + 1, image.width - 1);
+                int y0 = std::min(2 * y, image.height - 1);
+                int y1 = std::min(2 * y + 1, image.height - 1);
+                result.at(x, y) = (image.at(x0, y0) + image.at(x1, y0) +
+                                   image.at(x0, y1) + image.at(x1, y1)) *
+                                  0.25;
+            }
+        }
+        return result;
+    }
+};
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#include "Common.h"
+
+// Timeline of what the renderer's threads spend their time on, written as
+// Chrome trace JSON for chrome://tracing or Perfetto.
+//
+// Scopes are recorded with the TRACE_SCOPE macros, which compile to nothing
+// unless RT_TRACE is defined. When compiled in, a scope costs one relaxed
+// atomic load until tracing is started. Every thread appends to its own
+// ring buffer, so recording takes no lock; once a buffer is full the oldest
+// events are overwritten. Buffers of finished threads are handed to the
+// next new thread, so threads that come and go, such as those of a
+// WorkerPool made for one render, share a few timeline rows instead of
+// adding one each. Threads named before tracing starts keep their name.
+namespace Trace {
+
+struct Event {
+    const char* name;      // Must outlive the trace, e.g. a literal
+    const char* arg_name;  // Null if the event has no argument
+    int64_t arg;
+    uint64_t begin;  // Nanoseconds since the trace clock's epoch
+    uint64_t end;
+};
+
+class ThreadBuffer {
+   private:
+    vector<Event> _events;
+    std::atomic<uint64_t> _written{0};
+
+   public:
+    const int id;
+    std::string name;
+
+    ThreadBuffer(int id, size_t capacity)
+        : _events(capacity), id(id), name("thread " + std::to_string(id)) {}
+
+    void push(const Event& event) {
+        uint64_t n = _written.load(std::memory_order_relaxed);
+        _events[n % _events.size()] = event;
+        _written.store(n + 1, std::memory_order_release);
+    }
+
+    // Call f on every event still held, oldest first.
+    template <typename F>
+    void for_each(F&& f) const {
+        uint64_t n = _written.load(std::memory_order_acquire);
+        uint64_t first = n > _events.size() ? n - _events.size() : 0;
+        for (uint64_t i = first; i < n; ++i) f(_events[i % _events.size()]);
+    }
+
+    void clear() { _written.store(0, std::memory_order_relaxed); }
+};
+
+inline std::atomic<bool> enabled{false};
+
+struct Registry {
+    std::mutex mutex;
+    vector<shared_ptr<ThreadBuffer>> buffers;
+    vector<shared_ptr<ThreadBuffer>> idle;
+    size_t capacity = 1 << 16;
+};
+
+inline Registry& registry() {
+    static Registry r;
+    return r;
+}
+
+inline uint64_t now() {
+    static const auto epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - epoch)
+        .count();
+}
+
+// Name given to the calling thread, empty if none.
+inline std::string& thread_name() {
+    thread_local std::string name;
+    return name;
+}
+
+// This thread's buffer, taken from the registry on first use and given
+// back when the thread exits.
+inline ThreadBuffer& thread_buffer() {
+    struct Holder {
+        shared_ptr<ThreadBuffer> buffer;
+        ~Holder() {
+            if (!buffer) return;
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            r.idle.push_back(buffer);
+        }
+    };
+    thread_local Holder holder;
+    if (!holder.buffer) {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        if (!r.idle.empty()) {
+            holder.buffer = r.idle.back();
+            r.idle.pop_back();
+        } else {
+            holder.buffer = make_shared<ThreadBuffer>(
+                static_cast<int>(r.buffers.size()), r.capacity);
+            r.buffers.push_back(holder.buffer);
+        }
+        if (!thread_name().empty()) holder.buffer->name = thread_name();
+    }
+    return *holder.buffer;
+}
+
+// Start recording with room for capacity events per thread, dropping
+// anything recorded before.
+inline void start(size_t capacity = 1 << 16) {
+    Registry& r = registry();
+    {
+        std::lock_guard<std::mutex> lock(r.mutex);
+        if (r.buffers.empty()) r.capacity = std::max<size_t>(capacity, 1);
+        for (auto& buffer : r.buffers) buffer->clear();
+    }
+    now();
+    enabled.store(true, std::memory_order_relaxed);
+}
+
+inline void stop() { enabled.store(false, std::memory_order_relaxed); }
+
+// Label the calling thread's row in the timeline. Threads that live long,
+// such as those of a WorkerPool, call this once when they start.
+inline void set_thread_name(const std::string& name) {
+    thread_name() = name;
+    if (enabled.load(std::memory_order_relaxed)) thread_buffer().name = name;
+}
+
+// Write everything recorded as Chrome trace JSON. Call it while no thread
+// is recording, e.g. after stop().
+inline void write(const std::string& filename) {
+    std::ofstream outfile(filename);
+    if (!outfile) throw std::runtime_error("Cannot write " + filename);
+    outfile << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    auto separator = [&]() -> const char* {
+        const char* s = first ? "\n" : ",\n";
+        first = false;
+        return s;
+    };
+
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (const auto& buffer : r.buffers) {
+        outfile << separator()
+                << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                << "\"tid\":" << buffer->id << ",\"args\":{\"name\":\""
+                << buffer->name << "\"}}";
+        buffer->for_each([&](const Event& e) {
+            outfile << separator() << "{\"name\":\"" << e.name
+                    << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id
+                    << ",\"ts\":" << e.begin / 1000.0
+                    << ",\"dur\":" << (e.end - e.begin) / 1000.0;
+            if (e.arg_name)
+                outfile << ",\"args\":{\"" << e.arg_name << "\":" << e.arg
+                        << "}";
+            outfile << "}";
+        });
+    }
+    outfile << "\n]}\n";
+}
+
+// Records the time from its construction to its destruction as one event.
+class Scope {
+   private:
+    const char* _name;
+    const char* _arg_name;
+    int64_t _arg;
+    uint64_t _begin = 0;
+    bool _active;
+
+   public:
+    explicit Scope(const char* name, const char* arg_name = nullptr,
+                   int64_t arg = 0)
+        : _name(name), _arg_name(arg_name), _arg(arg),
+          _active(enabled.load(std::memory_order_relaxed)) {
+        if (_active) _begin = now();
+    }
+    ~Scope() {
+        if (_active)
+            thread_buffer().push({_name, _arg_name, _arg, _begin, now()});
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+};
+
+}  // namespace Trace
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+
+#ifdef RT_TRACE
+// Record the enclosing scope under name.
+#define TRACE_SCOPE(name) \
+    Trace::Scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+// Record the enclosing scope under name with one integer argument.
+#define TRACE_SCOPE_ARG(name, arg_name, arg) \
+    Trace::Scope TRACE_CONCAT(trace_scope_, __LINE__)(name, arg_name, arg)
+#define TRACE_THREAD_NAME(name) Trace::set_thread_name(name)
+#else
+#define TRACE_SCOPE(name)
+#define TRACE_SCOPE_ARG(name, arg_name, arg)
+#define TRACE_THREAD_NAME(name)
+#endif
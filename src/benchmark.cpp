@@ -0,0 +1,78 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "Benchmark.h"
+#include "Trace.h"
+
+// Usage: RayTracingBenchmark [--make-reference] [--scene name]...
+//                            [--budgets 0.5,1,2] [--reference-spp n]
+//                            [--reference-dir dir] [--packet-size n]
+//                            [--path-guiding] [--caustic-photons n]
+//                            [--trace trace.json]
+int main(int argc, char const *argv[]) {
+    BenchmarkOption option;
+    vector<std::string> scenes;
+    bool make_reference = false;
+    std::string trace_file;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) throw std::runtime_error(arg + " needs a value");
+            return argv[++i];
+        };
+        if (arg == "--make-reference") {
+            make_reference = true;
+        } else if (arg == "--scene") {
+            scenes.push_back(next());
+        } else if (arg == "--budgets") {
+            option.budgets.clear();
+            std::istringstream iss(next());
+            std::string budget;
+            while (std::getline(iss, budget, ',')) {
+                option.budgets.push_back(std::stod(budget));
+            }
+        } else if (arg == "--reference-spp") {
+            option.reference_spp = std::stoi(next());
+        } else if (arg == "--reference-dir") {
+            option.reference_dir = next();
+        } else if (arg == "--packet-size") {
+            option.packet_size = std::stoi(next());
+        } else if (arg == "--path-guiding") {
+            option.path_guiding = true;
+        } else if (arg == "--caustic-photons") {
+            option.caustic_photons = std::stoi(next());
+        } else if (arg == "--trace") {
+            trace_file = next();
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (scenes.empty())
+        scenes = {"cornel_box", "random_spheres", "sunny_spheres",
+                  "glowing_spheres"};
+
+    if (!trace_file.empty()) Trace::start();
+
+    vector<BenchmarkResult> results;
+    for (const auto &scene : scenes) {
+        if (make_reference) {
+            std::cout << "Reference " << scene << " ("
+                      << option.reference_spp << " spp)" << std::endl;
+            Benchmark::make_reference(scene, option);
+            continue;
+        }
+        auto scene_results = Benchmark::run(scene, option);
+        results.insert(results.end(), scene_results.begin(),
+                       scene_results.end());
+    }
+    if (!make_reference) Benchmark::print_table(results);
+
+    if (!trace_file.empty()) {
+        Trace::stop();
+        Trace::write(trace_file);
+    }
+    return 0;
+}
@@ -3,12 +3,19 @@
 #include <iomanip>
 #include <iostream>
 
+#include "AutoTuner.h"
 #include "Camera.h"
+#include "EnvironmentMap.h"
 #include "Image.h"
 #include "Renderer.h"
 #include "Scene.h"
 #include "SceneBuilder.h"
+#include "Trace.h"
 
+// Usage: RayTracingRenderer [--trace trace.json] [--autotune]
+//                           [--integrator path|albedo|normal|depth|ao|direct]
+//                           [--geometry field.rtg [--geometry-budget MB]]
+//                           [environment.hdr|.pfm]
 int main(int argc, char const *argv[]) {
     double aspect_ratio = 16.0 / 9.0;
     int width = 400;
@@ -17,9 +24,81 @@ int main(int argc, char const *argv[]) {
     int max_depth = 50;
     std::string outfile = "test.ppm";
 
+    std::string environment;
+    std::string trace_file;
+    std::string geometry_file;
+    size_t geometry_budget = 256;
+    bool autotune = false;
+    std::string integrator_name = "path";
+    auto usage = [&]() {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--trace trace.json] [--autotune]\n"
+                  << "    [--integrator path|albedo|normal|depth|ao|direct]\n"
+                  << "    [--geometry field.rtg [--geometry-budget MB]]\n"
+                  << "    [environment.hdr|.pfm]" << std::endl;
+        return 1;
+    };
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--trace" && i + 1 < argc) {
+            trace_file = argv[++i];
+        } else if (arg == "--integrator" && i + 1 < argc) {
+            integrator_name = argv[++i];
+        } else if (arg == "--geometry" && i + 1 < argc) {
+            geometry_file = argv[++i];
+        } else if (arg == "--geometry-budget" && i + 1 < argc) {
+            geometry_budget = std::stoull(argv[++i]);
+        } else if (arg == "--autotune") {
+            autotune = true;
+        } else if (arg.rfind("--", 0) == 0) {
+            // Unknown flags and flags missing their value.
+            std::cerr << "Unknown argument or missing value: " << arg
+                      << std::endl;
+            return usage();
+        } else if (!environment.empty()) {
+            std::cerr << "More than one environment map: " << arg
+                      << std::endl;
+            return usage();
+        } else {
+            environment = arg;
+        }
+    }
+    if (!trace_file.empty()) {
+        Trace::start();
+        TRACE_THREAD_NAME("main");
+    }
+
     ImageOption imageOption{width, height};
     RenderOption renderOption{samples_per_pixel, max_depth};
-    Scene scene = SceneBuilder::cornel_box();
+    renderOption.integrator = integrator_by_name(integrator_name);
+    // Out-of-core sphere field (see RayTracingGeometry) instead of the
+    // Cornell box, paged in within the given budget.
+    shared_ptr<GeometryCache> geometry_cache;
+    if (!geometry_file.empty())
+        geometry_cache = make_shared<GeometryCache>(geometry_budget << 20);
+    Scene scene = geometry_cache
+                      ? SceneBuilder::paged_spheres(geometry_file,
+                                                    geometry_cache)
+                      : SceneBuilder::cornel_box();
+    // Optional lat-long environment map (.pfm or .hdr) replacing the sky.
+    if (!environment.empty()) {
+        scene.background =
+            make_shared<EnvironmentMap>(HDR_Image::read(environment));
+    }
+
+    // Threads, tile size and BVH leaf size measured on this host, reused
+    // from its cache file after the first run.
+    if (autotune) {
+        std::string key = AutoTuner::workload_key(
+            geometry_cache ? "paged_spheres" : "cornel_box", integrator_name,
+            {geometry_file, environment});
+        TunedSettings tuned =
+            AutoTuner().settings(key, scene, renderOption);
+        tuned.apply(scene, renderOption);
+        std::cout << "Auto-tuned: " << tuned.threads << " threads, tile "
+                  << tuned.tile_size << ", BVH leaf " << tuned.leaf_size
+                  << std::endl;
+    }
 
     PPM_Image image(imageOption, outfile);
     RendererPtr renderer = make_shared<CPU_MT_Renderer>(scene);
@@ -32,6 +111,14 @@ int main(int argc, char const *argv[]) {
                                                                   start_time)
                      .count()
               << "s" << std::endl;
+    if (geometry_cache) {
+        auto stats = geometry_cache->stats();
+        std::cout << "Geometry page-ins: " << stats.page_ins << " ("
+                  << (stats.bytes_read >> 20) << " MiB read), hits: "
+                  << stats.hits << ", evictions: " << stats.evictions
+                  << ", peak resident: " << (stats.peak_bytes >> 20)
+                  << " MiB" << std::endl;
+    }
     start_time = time();
     image.write();
     std::cout << "Image output time: "
@@ -40,5 +127,10 @@ int main(int argc, char const *argv[]) {
                      .count()
               << "s" << std::endl;
 
+    if (!trace_file.empty()) {
+        Trace::stop();
+        Trace::write(trace_file);
+        std::cout << "Trace written to " << trace_file << std::endl;
+    }
     return 0;
 }
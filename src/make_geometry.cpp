@@ -0,0 +1,29 @@
+#include <iostream>
+#include <string>
+
+#include "ClusterFile.h"
+#include "SceneBuilder.h"
+
+// Usage: RayTracingGeometry output.rtg [sphere_count] [cluster_size] [seed]
+//
+// Writes a field of random spheres (SceneBuilder::sphere_field) as a cluster
+// file for SceneBuilder::paged_spheres.
+int main(int argc, char const *argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0]
+                  << " output.rtg [sphere_count] [cluster_size] [seed]"
+                  << std::endl;
+        return 1;
+    }
+    size_t count = argc > 2 ? std::stoull(argv[2]) : 1000000;
+    size_t cluster_size = argc > 3 ? std::stoull(argv[3]) : 1024;
+    unsigned int seed = argc > 4 ? std::stoul(argv[4]) : 0;
+
+    ClusterFile::write(SceneBuilder::sphere_field(count, seed), argv[1],
+                       cluster_size);
+
+    ClusterFile file(argv[1], {});
+    std::cout << count << " spheres in " << file.clusters() << " clusters"
+              << std::endl;
+    return 0;
+}
@@ -0,0 +1,25 @@
+#include <iostream>
+#include <string>
+
+#include "HDRImage.h"
+#include "TiledTexture.h"
+
+// Usage: RayTracingTexture input.(pfm|hdr|ppm) output.rtt [tile_size]
+int main(int argc, char const *argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0]
+                  << " input.(pfm|hdr|ppm) output.rtt [tile_size]"
+                  << std::endl;
+        return 1;
+    }
+    int tile_size = argc > 3 ? std::stoi(argv[3]) : 64;
+
+    HDR_Image image = HDR_Image::read(argv[1]);
+    TiledTexture::write(image, argv[2], tile_size);
+
+    TiledTexture texture(argv[2]);
+    std::cout << image.width << "x" << image.height << ", "
+              << texture.levels() << " mip levels, " << tile_size << "x"
+              << tile_size << " tiles" << std::endl;
+    return 0;
+}
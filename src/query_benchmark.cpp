@@ -0,0 +1,101 @@
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "Plane.h"
+#include "RayQuery.h"
+#include "Sphere.h"
+
+// Usage: RayTracingQueryBenchmark [sphere_count] [ray_count] [threads]
+//
+// Answers queries with RayQuery among random spheres over a ground plane
+// and prints their throughput: line of sight between random points, the
+// closest hits along the same segments, and the closest hits of a sensor
+// sweeping its surroundings ring by ring.
+int main(int argc, char const *argv[]) {
+    size_t sphere_count = argc > 1 ? std::stoull(argv[1]) : 100000;
+    size_t ray_count = argc > 2 ? std::stoull(argv[2]) : 1000000;
+    unsigned int threads = argc > 3 ? std::stoul(argv[3]) : 0;
+
+    std::mt19937 random(0);
+    std::uniform_real_distribution<Real> uniform(0, 1);
+    Real extent = 100, height = 10;
+    vector<shared_ptr<Geometry>> objects;
+    objects.push_back(
+        make_shared<Plane>(Point3{0, 0, 0}, Vec3{0, 1, 0}, nullptr));
+    for (size_t i = 0; i < sphere_count; ++i) {
+        Point3 center{uniform(random) * extent, uniform(random) * height,
+                      uniform(random) * extent};
+        objects.push_back(
+            make_shared<Sphere>(center, 0.1 + 0.4 * uniform(random), nullptr));
+    }
+
+    auto pool = make_shared<WorkerPool>(threads);
+    auto start = std::chrono::steady_clock::now();
+    auto seconds = [&]() {
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - start).count();
+        start = now;
+        return elapsed;
+    };
+    RayQuery query(objects, pool);
+    std::cout << objects.size() << " objects, BVH built in " << seconds()
+              << " s, " << pool->size() << " threads" << std::endl;
+
+    RayBatch segments, sweep;
+    segments.reserve(ray_count);
+    sweep.reserve(ray_count);
+    auto random_point = [&]() {
+        return Point3{uniform(random) * extent,
+                      0.1 + uniform(random) * height,
+                      uniform(random) * extent};
+    };
+    const size_t azimuths = 2000;
+    Point3 sensor{extent / 2, height / 2, extent / 2};
+    for (size_t i = 0; i < ray_count; ++i) {
+        Point3 from = random_point();
+        segments.add(from, random_point() - from, 1);
+
+        Real azimuth = 2 * Math::PI * (i % azimuths) / azimuths;
+        Real elevation = 0.6 * ((i / azimuths) % 100) / 100.0 - 0.3;
+        sweep.add(sensor, Vec3{cos(elevation) * cos(azimuth),
+                               sin(elevation),
+                               cos(elevation) * sin(azimuth)},
+                  extent / 3);
+    }
+
+    auto report = [&](const std::string &name, size_t count) {
+        double rate = count / seconds() / 1e6;
+        std::cout << name << ": " << rate << " Mrays/s, "
+                  << rate / pool->size() << " Mrays/s per thread"
+                  << std::endl;
+    };
+
+    seconds();
+    vector<uint8_t> occluded;
+    query.any_hit(segments, occluded);
+    report("line of sight", segments.size());
+
+    HitBatch hits;
+    query.closest_hit(segments, hits);
+    report("closest hit, segments", segments.size());
+    size_t blocked = 0;
+    for (uint8_t o : occluded) blocked += o;
+    bool agree = hits.size() == blocked;
+    for (uint32_t i : hits.ray) agree = agree && occluded[i];
+
+    seconds();
+    query.closest_hit(sweep, hits);
+    report("closest hit, sweep", sweep.size());
+
+    std::cout << segments.size() - blocked << " of " << segments.size()
+              << " segments unobstructed, " << hits.size() << " of "
+              << sweep.size() << " sweep rays hit" << std::endl;
+    if (!agree) {
+        std::cerr << "Line of sight and closest hits disagree" << std::endl;
+        return 1;
+    }
+    return 0;
+}